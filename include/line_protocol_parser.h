@@ -1,6 +1,8 @@
 #ifndef LINEPROTOCOLPARSER_H
 #define LINEPROTOCOLPARSER_H
 
+#include <stddef.h>
+
 /* Error return codes of `LP_parse_line` */
 #define LP_MEMORY_ERROR 1
 #define LP_LINE_EMPTY 2
@@ -14,6 +16,9 @@
 #define LP_FIELD_VALUE_TYPE_ERROR 10
 #define LP_TIME_ERROR 11
 
+/* Error return code of `LP_load_batch` (besides LP_MEMORY_ERROR) */
+#define LP_BATCH_ERROR 12
+
 /* Indicates which type a field has */
 enum LP_ValueType {
     LP_FLOAT, LP_INTEGER, LP_UINTEGER, LP_BOOLEAN, LP_STRING
@@ -54,7 +59,193 @@ struct LP_Point {
 
 struct LP_Point*
 LP_parse_line(const char *line, int *status);
+struct LP_Point*
+LP_parse_line_n(const char *line, size_t length, int *status);
+struct LP_Point*
+LP_parse_lines(const char *data, size_t length, int *status, size_t *lineno);
+size_t
+LP_next_line(const char *data, size_t length, size_t *next);
+int
+LP_is_blank_line(const char *line, size_t length);
 void
 LP_free_point(struct LP_Point *point);
 
+/* Buffer of raw line protocol input. New input is written at `end`, whole
+ * lines are consumed from `start`. When `max_size` is set the buffer does
+ * not grow beyond it, longer lines are skipped and counted in `too_long`. */
+struct LP_LineBuffer {
+    char *data;
+    size_t size;
+    size_t start;
+    size_t end;
+    size_t max_size; // 0 for no limit
+    int skipping; // Dropping input up to the next newline
+    unsigned long long too_long;
+};
+
+int
+LP_init_line_buffer(struct LP_LineBuffer *buffer, size_t size);
+char*
+LP_line_buffer_space(struct LP_LineBuffer *buffer, size_t *space);
+void
+LP_line_buffer_commit(struct LP_LineBuffer *buffer, size_t length);
+int
+LP_line_buffer_next(struct LP_LineBuffer *buffer, int final,
+                    const char **line, size_t *length);
+void
+LP_free_line_buffer(struct LP_LineBuffer *buffer);
+
+/* A run of whole lines in a file and the time range of their points */
+struct LP_TimeBlock {
+    unsigned long long offset;
+    unsigned long long length;
+    unsigned long long min_time;
+    unsigned long long max_time;
+};
+
+/* Sparse index of a line protocol file, one block per `block_size`
+ * bytes. `file_size` and `file_mtime` identify the indexed file. */
+struct LP_TimeIndex {
+    struct LP_TimeBlock *blocks;
+    size_t nr_blocks;
+    size_t capacity;
+    unsigned long long block_size;
+    unsigned long long offset;
+    unsigned long long file_size;
+    unsigned long long file_mtime;
+};
+
+int
+LP_scan_time(const char *line, size_t length, unsigned long long *time);
+int
+LP_init_time_index(struct LP_TimeIndex *index, unsigned long long block_size);
+size_t
+LP_time_index_scan(struct LP_TimeIndex *index, const char *data, size_t length,
+                   int final, int *status);
+size_t
+LP_time_index_encoded_size(const struct LP_TimeIndex *index);
+void
+LP_encode_time_index(const struct LP_TimeIndex *index, char *out);
+int
+LP_decode_time_index(struct LP_TimeIndex *index, const char *data, size_t length);
+void
+LP_free_time_index(struct LP_TimeIndex *index);
+
+/* Status codes of `LP_listener_get` and `LP_listener_feed` */
+#define LP_LISTENER_TIMEOUT 1
+#define LP_LISTENER_CLOSED 2
+#define LP_LISTENER_ERROR 3
+
+/* Longest line accepted from a stream socket, longer lines are errors */
+#define LP_LISTENER_MAX_LINE (1 << 20)
+/* Most datagrams received per call (UIO_MAXIOV, recvmmsg's limit) */
+#define LP_LISTENER_MAX_BATCH 1024
+
+/* Receives line protocol from a UDP or TCP socket on a background thread
+ * and queues the parsed points in batches (POSIX only). */
+struct LP_Listener;
+
+struct LP_ListenerStats {
+    unsigned long long reads; // Datagrams, stream reads or fed chunks
+    unsigned long long bytes;
+    unsigned long long points; // Points queued
+    unsigned long long errors; // Lines that could not be parsed
+    unsigned long long dropped; // Points dropped because the queue was full
+    unsigned long long blocked; // Batches that waited for room in the queue
+    unsigned long long queued; // Batches currently in the queue
+};
+
+struct LP_Listener*
+LP_new_listener(int fd, size_t max_batch, size_t datagram_size, size_t max_queue,
+                int block);
+void
+LP_listener_feed(struct LP_Listener *listener, const char *data, size_t length,
+                 long timeout_ms, int *status);
+struct LP_Point*
+LP_listener_get(struct LP_Listener *listener, long timeout_ms, int *status);
+int
+LP_listener_error(struct LP_Listener *listener);
+void
+LP_listener_stats(struct LP_Listener *listener, struct LP_ListenerStats *stats);
+void
+LP_close_listener(struct LP_Listener *listener);
+void
+LP_free_listener(struct LP_Listener *listener);
+
+/* Reads a batch encoded by `LP_dump_batch` in place, see src/batch.c.
+ * Strings, series and shapes are indexed when opened, points are read in
+ * order. */
+struct LP_BatchReader {
+    size_t nr_strings;
+    size_t nr_series;
+    size_t nr_shapes;
+    size_t nr_points;
+    const char *strings;
+    size_t *offsets; // nr_strings + 1 into `strings`
+    size_t *series; // nr_series + 1 into `series_items`
+    size_t *series_items;
+    size_t *shapes; // nr_shapes + 1 into `shape_items`
+    size_t *shape_items;
+    const char *position;
+    const char *end;
+    size_t point;
+    unsigned long long time;
+};
+
+/* A point of a batch. Series (measurement and tags) and shapes (field
+ * keys and types) are shared by the points, and numbered so they can be
+ * looked up once. */
+struct LP_BatchPoint {
+    unsigned long long time;
+    size_t series;
+    size_t measurement;
+    size_t nr_tags;
+    const size_t *tags; // Key and value string index per tag
+    size_t shape;
+    size_t nr_fields;
+    const size_t *fields; // Key string index and type per field
+};
+
+char*
+LP_dump_batch(const struct LP_Point *points, size_t *length);
+struct LP_Point*
+LP_load_batch(const char *data, size_t length, int *status);
+int
+LP_open_batch(struct LP_BatchReader *reader, const char *data, size_t length);
+const char*
+LP_batch_string(const struct LP_BatchReader *reader, size_t index, size_t *length);
+size_t
+LP_batch_series(const struct LP_BatchReader *reader, size_t index,
+                size_t *measurement, const size_t **tags);
+size_t
+LP_batch_shape(const struct LP_BatchReader *reader, size_t index,
+               const size_t **fields);
+int
+LP_batch_next_point(struct LP_BatchReader *reader, struct LP_BatchPoint *point);
+int
+LP_batch_next_value(struct LP_BatchReader *reader, enum LP_ValueType type,
+                    union LP_Value *value);
+void
+LP_close_batch(struct LP_BatchReader *reader);
+
+/* Groups points by series (measurement and tags) and time bucket and
+ * keeps count/min/max/sum/last of the numeric fields. Closed buckets are
+ * emitted as points with fields named e.g. "min_<key>". Points without
+ * numeric fields are skipped. */
+struct LP_Aggregator;
+
+struct LP_Aggregator*
+LP_new_aggregator(unsigned long long interval, unsigned long long lateness,
+                  size_t max_rows);
+int
+LP_aggregate_point(struct LP_Aggregator *agg, const struct LP_Point *point);
+struct LP_Point*
+LP_aggregator_closed(struct LP_Aggregator *agg, int flush);
+void
+LP_aggregator_counters(const struct LP_Aggregator *agg,
+                       unsigned long long *late, unsigned long long *evicted,
+                       unsigned long long *conflicts);
+void
+LP_free_aggregator(struct LP_Aggregator *agg);
+
 #endif
\ No newline at end of file
@@ -1,5 +1,12 @@
 """Module for parsing InfluxDB line protocol strings"""
-from ._line_protocol_parser import parse_line, LineFormatError
+from ._line_protocol_parser import (
+    parse_line, parse_file, build_index, dump_batch, load_batch,
+    Aggregator, Reader, LineFormatError)
+try:
+    from ._line_protocol_parser import Listener
+except ImportError:
+    # Not available on Windows
+    pass
 
 # Module metadata
 __author__ = 'Daniel Andersson'
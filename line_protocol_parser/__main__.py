@@ -0,0 +1,26 @@
+"""Command line tools of line_protocol_parser
+
+Usage: python3 -m line_protocol_parser index [--block-size N] FILE...
+"""
+
+import argparse
+
+from . import build_index
+
+
+def main():
+    parser = argparse.ArgumentParser(prog='python3 -m line_protocol_parser')
+    commands = parser.add_subparsers(dest='command', required=True)
+    index = commands.add_parser(
+        'index', help='write a sparse time index (FILE.lpidx) for parse_file')
+    index.add_argument('files', metavar='FILE', nargs='+')
+    index.add_argument('--block-size', type=int, default=1 << 20,
+                       help='approximate bytes per index block')
+    args = parser.parse_args()
+    for path in args.files:
+        blocks = build_index(path, block_size=args.block_size)
+        print('{}: {} blocks'.format(path, blocks))
+
+
+if __name__ == '__main__':
+    main()
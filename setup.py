@@ -33,11 +33,13 @@ setup(
     ext_modules=[
         Extension(
             'line_protocol_parser._line_protocol_parser',
-            sources=['src/line_protocol_parser.c', 'src/module.c'],
+            sources=['src/line_protocol_parser.c', 'src/line_buffer.c',
+                     'src/aggregate.c', 'src/time_index.c', 'src/listener.c',
+                     'src/batch.c', 'src/module.c'],
             include_dirs=['include'],
             define_macros=[
-                ('LP_MALLOC', 'PyMem_Malloc'),
-                ('LP_FREE', 'PyMem_Free'),
+                ('LP_MALLOC', 'PyMem_RawMalloc'),
+                ('LP_FREE', 'PyMem_RawFree'),
                 ('PY_SSIZE_T_CLEAN', None)
             ],
             extra_compile_args=extra_compile_args)
@@ -0,0 +1,572 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "line_protocol_parser.h"
+
+/* (Used to override malloc/free in Python C extension) */
+#ifndef LP_MALLOC
+#define LP_MALLOC malloc
+#endif
+#ifndef LP_FREE
+#define LP_FREE free
+#endif
+
+/* Running statistics of one numeric field within a row. Values are kept
+ * in the same union as `LP_Item`, unsigned integers are stored in `i`
+ * just like the parser does. */
+struct _LP_Stat {
+    char *key;
+    enum LP_ValueType type;
+    signed long long count;
+    union LP_Value min;
+    union LP_Value max;
+    union LP_Value sum;
+    union LP_Value last;
+    struct _LP_Stat *next_stat;
+};
+
+/* An open (not yet emitted) aggregate of one series within one bucket */
+struct _LP_Row {
+    char *series;
+    size_t series_length;
+    unsigned long long hash;
+    unsigned long long bucket;
+    char *measurement;
+    struct LP_Item *tags;
+    struct _LP_Stat *stats;
+    struct _LP_Stat *last_stat;
+    struct _LP_Row *next_in_slot;
+    struct _LP_Row *prev_row;
+    struct _LP_Row *next_row;
+};
+
+struct LP_Aggregator {
+    unsigned long long interval;
+    unsigned long long lateness;
+    unsigned long long watermark;
+    unsigned long long closed_before;
+    size_t max_rows;
+    size_t nr_rows;
+    size_t nr_slots;
+    struct _LP_Row **slots;
+    /* Open rows in the order they were created */
+    struct _LP_Row *first_row;
+    struct _LP_Row *last_row;
+    /* Emitted rows waiting to be collected */
+    struct LP_Point *closed;
+    struct LP_Point *last_closed;
+    /* Reused buffers for building series keys */
+    char *scratch;
+    size_t scratch_size;
+    struct LP_Item **tag_order;
+    size_t tag_order_size;
+    unsigned long long late;
+    unsigned long long evicted;
+    unsigned long long conflicts;
+};
+
+static char*
+copy_string(const char *prefix, const char *str)
+{
+    size_t prefix_length = strlen(prefix);
+    size_t length = strlen(str);
+    char *output = LP_MALLOC(prefix_length + length + 1);
+    if (output == NULL) {
+        return NULL;
+    }
+    memcpy(output, prefix, prefix_length);
+    memcpy(output + prefix_length, str, length + 1);
+    return output;
+}
+
+static void
+free_items(struct LP_Item *item)
+{
+    struct LP_Item *tmp = NULL;
+    while (item != NULL) {
+        tmp = item->next_item;
+        LP_FREE(item->key);
+        if (item->type == LP_STRING) {
+            LP_FREE(item->value.s);
+        }
+        LP_FREE(item);
+        item = tmp;
+    }
+}
+
+static void
+free_row(struct _LP_Row *row)
+{
+    struct _LP_Stat *tmp = NULL;
+    if (row == NULL) {
+        return;
+    }
+    while (row->stats != NULL) {
+        tmp = row->stats->next_stat;
+        LP_FREE(row->stats->key);
+        LP_FREE(row->stats);
+        row->stats = tmp;
+    }
+    free_items(row->tags);
+    LP_FREE(row->measurement);
+    LP_FREE(row->series);
+    LP_FREE(row);
+}
+
+static int
+compare_tag_keys(const void *a, const void *b)
+{
+    return strcmp((*(struct LP_Item * const *)a)->key,
+                  (*(struct LP_Item * const *)b)->key);
+}
+
+/* Write the series key (measurement and tags sorted by key, each string
+ * NUL-terminated) of `point` to the scratch buffer. Returns the length of
+ * the key, or 0 on memory error. */
+static size_t
+build_series(struct LP_Aggregator *agg, const struct LP_Point *point)
+{
+    const struct LP_Item *tag = NULL;
+    size_t nr_tags = 0;
+    size_t length = strlen(point->measurement) + 1;
+    size_t i, n;
+    void *tmp = NULL;
+
+    for (tag = point->tags; tag != NULL; tag = tag->next_item) {
+        length += strlen(tag->key) + strlen(tag->value.s) + 2;
+        nr_tags++;
+    }
+    if (length > agg->scratch_size) {
+        if ((tmp = LP_MALLOC(length)) == NULL) {
+            return 0;
+        }
+        LP_FREE(agg->scratch);
+        agg->scratch = tmp;
+        agg->scratch_size = length;
+    }
+    if (nr_tags > agg->tag_order_size) {
+        if ((tmp = LP_MALLOC(nr_tags * sizeof(*agg->tag_order))) == NULL) {
+            return 0;
+        }
+        LP_FREE(agg->tag_order);
+        agg->tag_order = tmp;
+        agg->tag_order_size = nr_tags;
+    }
+    i = 0;
+    for (tag = point->tags; tag != NULL; tag = tag->next_item) {
+        agg->tag_order[i++] = (struct LP_Item *)tag;
+    }
+    qsort(agg->tag_order, nr_tags, sizeof(*agg->tag_order), compare_tag_keys);
+
+    n = strlen(point->measurement) + 1;
+    memcpy(agg->scratch, point->measurement, n);
+    length = n;
+    for (i = 0; i < nr_tags; i++) {
+        n = strlen(agg->tag_order[i]->key) + 1;
+        memcpy(agg->scratch + length, agg->tag_order[i]->key, n);
+        length += n;
+        n = strlen(agg->tag_order[i]->value.s) + 1;
+        memcpy(agg->scratch + length, agg->tag_order[i]->value.s, n);
+        length += n;
+    }
+    return length;
+}
+
+/* FNV-1a of the series key, mixed with the bucket */
+static unsigned long long
+hash_series(const char *series, size_t length, unsigned long long bucket)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)series[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= bucket;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+static struct LP_Item*
+append_item(struct LP_Item ***tail, const char *prefix, const char *key,
+            enum LP_ValueType type, union LP_Value value)
+{
+    struct LP_Item *item = LP_MALLOC(sizeof(*item));
+    if (item == NULL) {
+        return NULL;
+    }
+    if ((item->key = copy_string(prefix, key)) == NULL) {
+        LP_FREE(item);
+        return NULL;
+    }
+    item->type = type;
+    item->value = value;
+    item->next_item = NULL;
+    **tail = item;
+    *tail = &item->next_item;
+    return item;
+}
+
+/* Turn the row into a point holding count, min, max, sum and last of
+ * every field. */
+static struct LP_Point*
+row_to_point(struct _LP_Row *row)
+{
+    struct LP_Point *point = NULL;
+    struct LP_Item **tail = NULL;
+    struct _LP_Stat *stat = NULL;
+    union LP_Value count;
+
+    if ((point = LP_MALLOC(sizeof(*point))) == NULL) {
+        return NULL;
+    }
+    point->measurement = NULL;
+    point->tags = NULL;
+    point->fields = NULL;
+    point->time = row->bucket;
+    point->next_point = NULL;
+    tail = &point->fields;
+    for (stat = row->stats; stat != NULL; stat = stat->next_stat) {
+        count.i = stat->count;
+        if (append_item(&tail, "count_", stat->key, LP_INTEGER, count) == NULL
+            || append_item(&tail, "min_", stat->key, stat->type, stat->min) == NULL
+            || append_item(&tail, "max_", stat->key, stat->type, stat->max) == NULL
+            || append_item(&tail, "sum_", stat->key, stat->type, stat->sum) == NULL
+            || append_item(&tail, "last_", stat->key, stat->type, stat->last) == NULL) {
+            LP_free_point(point);
+            return NULL;
+        }
+    }
+    /* Hand over the strings, the row is freed by the caller */
+    point->measurement = row->measurement;
+    point->tags = row->tags;
+    row->measurement = NULL;
+    row->tags = NULL;
+    return point;
+}
+
+static void
+unlink_row(struct LP_Aggregator *agg, struct _LP_Row *row)
+{
+    struct _LP_Row **slot = &agg->slots[row->hash & (agg->nr_slots - 1)];
+    while (*slot != row) {
+        slot = &(*slot)->next_in_slot;
+    }
+    *slot = row->next_in_slot;
+    if (row->prev_row == NULL) {
+        agg->first_row = row->next_row;
+    } else {
+        row->prev_row->next_row = row->next_row;
+    }
+    if (row->next_row == NULL) {
+        agg->last_row = row->prev_row;
+    } else {
+        row->next_row->prev_row = row->prev_row;
+    }
+    agg->nr_rows--;
+}
+
+/* Emit the row to the list of closed points */
+static int
+close_row(struct LP_Aggregator *agg, struct _LP_Row *row)
+{
+    struct LP_Point *point = row_to_point(row);
+    if (point == NULL) {
+        return 0;
+    }
+    if (agg->last_closed == NULL) {
+        agg->closed = point;
+    } else {
+        agg->last_closed->next_point = point;
+    }
+    agg->last_closed = point;
+    unlink_row(agg, row);
+    free_row(row);
+    return 1;
+}
+
+static int
+close_rows_before(struct LP_Aggregator *agg, unsigned long long bucket)
+{
+    struct _LP_Row *row = agg->first_row;
+    struct _LP_Row *next = NULL;
+    while (row != NULL) {
+        next = row->next_row;
+        if (row->bucket < bucket && close_row(agg, row) == 0) {
+            return 0;
+        }
+        row = next;
+    }
+    return 1;
+}
+
+static struct _LP_Row*
+new_row(struct LP_Aggregator *agg, const struct LP_Point *point,
+        size_t series_length, unsigned long long hash, unsigned long long bucket)
+{
+    struct _LP_Row *row = NULL;
+    struct _LP_Row **slot = NULL;
+    const struct LP_Item *tag = NULL;
+    struct LP_Item *item = NULL;
+    struct LP_Item **tail = NULL;
+    union LP_Value value;
+
+    if ((row = LP_MALLOC(sizeof(*row))) == NULL) {
+        return NULL;
+    }
+    memset(row, 0, sizeof(*row));
+    if ((row->series = LP_MALLOC(series_length)) == NULL) {
+        goto error;
+    }
+    memcpy(row->series, agg->scratch, series_length);
+    row->series_length = series_length;
+    row->hash = hash;
+    row->bucket = bucket;
+    if ((row->measurement = copy_string("", point->measurement)) == NULL) {
+        goto error;
+    }
+    tail = &row->tags;
+    value.s = NULL;
+    for (tag = point->tags; tag != NULL; tag = tag->next_item) {
+        if ((item = append_item(&tail, "", tag->key, LP_STRING, value)) == NULL) {
+            goto error;
+        }
+        if ((item->value.s = copy_string("", tag->value.s)) == NULL) {
+            goto error;
+        }
+    }
+    slot = &agg->slots[hash & (agg->nr_slots - 1)];
+    row->next_in_slot = *slot;
+    *slot = row;
+    row->prev_row = agg->last_row;
+    if (agg->last_row == NULL) {
+        agg->first_row = row;
+    } else {
+        agg->last_row->next_row = row;
+    }
+    agg->last_row = row;
+    agg->nr_rows++;
+    return row;
+error:
+    free_row(row);
+    return NULL;
+}
+
+static int
+is_numeric(const struct LP_Item *field)
+{
+    return field->type == LP_FLOAT || field->type == LP_INTEGER
+        || field->type == LP_UINTEGER;
+}
+
+static int
+update_row(struct LP_Aggregator *agg, struct _LP_Row *row,
+           const struct LP_Point *point)
+{
+    const struct LP_Item *field = NULL;
+    struct _LP_Stat *stat = NULL;
+
+    for (field = point->fields; field != NULL; field = field->next_item) {
+        if (!is_numeric(field)) {
+            continue;
+        }
+        for (stat = row->stats; stat != NULL; stat = stat->next_stat) {
+            if (strcmp(stat->key, field->key) == 0) {
+                break;
+            }
+        }
+        if (stat == NULL) {
+            if ((stat = LP_MALLOC(sizeof(*stat))) == NULL) {
+                return 0;
+            }
+            if ((stat->key = copy_string("", field->key)) == NULL) {
+                LP_FREE(stat);
+                return 0;
+            }
+            stat->type = field->type;
+            stat->count = 1;
+            stat->min = stat->max = stat->sum = stat->last = field->value;
+            stat->next_stat = NULL;
+            if (row->last_stat == NULL) {
+                row->stats = stat;
+            } else {
+                row->last_stat->next_stat = stat;
+            }
+            row->last_stat = stat;
+            continue;
+        }
+        if (stat->type != field->type) {
+            /* Type conflict within the bucket, keep the first type */
+            agg->conflicts++;
+            continue;
+        }
+        stat->count++;
+        stat->last = field->value;
+        switch (field->type) {
+            case LP_FLOAT:
+                if (field->value.f < stat->min.f) stat->min.f = field->value.f;
+                if (field->value.f > stat->max.f) stat->max.f = field->value.f;
+                stat->sum.f += field->value.f;
+                break;
+            case LP_INTEGER:
+                if (field->value.i < stat->min.i) stat->min.i = field->value.i;
+                if (field->value.i > stat->max.i) stat->max.i = field->value.i;
+                stat->sum.i = (signed long long)((unsigned long long)stat->sum.i
+                                                 + (unsigned long long)field->value.i);
+                break;
+            case LP_UINTEGER:
+                if ((unsigned long long)field->value.i < (unsigned long long)stat->min.i)
+                    stat->min.i = field->value.i;
+                if ((unsigned long long)field->value.i > (unsigned long long)stat->max.i)
+                    stat->max.i = field->value.i;
+                stat->sum.i = (signed long long)((unsigned long long)stat->sum.i
+                                                 + (unsigned long long)field->value.i);
+                break;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+
+struct LP_Aggregator*
+LP_new_aggregator(unsigned long long interval, unsigned long long lateness,
+                  size_t max_rows)
+{
+    struct LP_Aggregator *agg = NULL;
+    size_t i;
+    if (interval == 0 || max_rows == 0) {
+        return NULL;
+    }
+    if ((agg = LP_MALLOC(sizeof(*agg))) == NULL) {
+        return NULL;
+    }
+    memset(agg, 0, sizeof(*agg));
+    agg->interval = interval;
+    agg->lateness = lateness;
+    agg->max_rows = max_rows;
+    /* Power of two with a load factor of at most one half */
+    agg->nr_slots = 16;
+    while (agg->nr_slots < 2 * max_rows && agg->nr_slots < ((size_t)1 << 24)) {
+        agg->nr_slots *= 2;
+    }
+    if ((agg->slots = LP_MALLOC(agg->nr_slots * sizeof(*agg->slots))) == NULL) {
+        LP_FREE(agg);
+        return NULL;
+    }
+    for (i = 0; i < agg->nr_slots; i++) {
+        agg->slots[i] = NULL;
+    }
+    return agg;
+}
+
+void
+LP_free_aggregator(struct LP_Aggregator *agg)
+{
+    struct _LP_Row *row = NULL;
+    struct _LP_Row *tmp = NULL;
+    if (agg == NULL) {
+        return;
+    }
+    row = agg->first_row;
+    while (row != NULL) {
+        tmp = row->next_row;
+        free_row(row);
+        row = tmp;
+    }
+    LP_free_point(agg->closed);
+    LP_FREE(agg->slots);
+    LP_FREE(agg->scratch);
+    LP_FREE(agg->tag_order);
+    LP_FREE(agg);
+}
+
+int
+LP_aggregate_point(struct LP_Aggregator *agg, const struct LP_Point *point)
+{
+    struct _LP_Row *row = NULL;
+    unsigned long long bucket = point->time - point->time % agg->interval;
+    unsigned long long horizon = 0;
+    unsigned long long hash = 0;
+    size_t series_length = 0;
+    const struct LP_Item *field = NULL;
+
+    field = point->fields;
+    while (field != NULL && !is_numeric(field)) {
+        field = field->next_item;
+    }
+    if (field == NULL) {
+        /* Nothing to aggregate */
+        return 1;
+    }
+    if (bucket < agg->closed_before) {
+        agg->late++;
+        return 1;
+    }
+    if (point->time > agg->watermark) {
+        agg->watermark = point->time;
+        if (agg->watermark >= agg->lateness) {
+            horizon = agg->watermark - agg->lateness;
+            horizon -= horizon % agg->interval;
+            if (horizon > agg->closed_before) {
+                agg->closed_before = horizon;
+                if (close_rows_before(agg, horizon) == 0) {
+                    return 0;
+                }
+            }
+        }
+    }
+    if ((series_length = build_series(agg, point)) == 0) {
+        return 0;
+    }
+    hash = hash_series(agg->scratch, series_length, bucket);
+    for (row = agg->slots[hash & (agg->nr_slots - 1)]; row != NULL;
+         row = row->next_in_slot) {
+        if (row->hash == hash && row->bucket == bucket
+            && row->series_length == series_length
+            && memcmp(row->series, agg->scratch, series_length) == 0) {
+            break;
+        }
+    }
+    if (row == NULL) {
+        if (agg->nr_rows >= agg->max_rows) {
+            /* Make room by emitting the oldest row ahead of time */
+            if (close_row(agg, agg->first_row) == 0) {
+                return 0;
+            }
+            agg->evicted++;
+        }
+        if ((row = new_row(agg, point, series_length, hash, bucket)) == NULL) {
+            return 0;
+        }
+    }
+    return update_row(agg, row, point);
+}
+
+struct LP_Point*
+LP_aggregator_closed(struct LP_Aggregator *agg, int flush)
+{
+    struct LP_Point *output = NULL;
+    if (flush) {
+        while (agg->first_row != NULL) {
+            if (close_row(agg, agg->first_row) == 0) {
+                break;
+            }
+        }
+    }
+    output = agg->closed;
+    agg->closed = NULL;
+    agg->last_closed = NULL;
+    return output;
+}
+
+void
+LP_aggregator_counters(const struct LP_Aggregator *agg,
+                       unsigned long long *late, unsigned long long *evicted,
+                       unsigned long long *conflicts)
+{
+    *late = agg->late;
+    *evicted = agg->evicted;
+    *conflicts = agg->conflicts;
+}
@@ -0,0 +1,714 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_protocol_parser.h"
+
+/* (Used to override malloc/free in Python C extension) */
+#ifndef LP_MALLOC
+#define LP_MALLOC malloc
+#endif
+#ifndef LP_FREE
+#define LP_FREE free
+#endif
+
+/* Binary encoding of a list of points. Integers are LEB128 varints
+ * unless noted, "zigzag" marks signed ones:
+ *
+ *   header   "LPBATCH1", number of strings, series, shapes and points,
+ *            then the size in bytes of each of the five sections below
+ *   lengths  length of every string
+ *   strings  UTF-8 data of every string, not terminated
+ *   series   measurement, number of tags, key and value per tag
+ *   shapes   number of fields, key and a type byte per field
+ *   points   series, shape, time (zigzag, difference to the previous
+ *            point) and the value of every field of the shape: float as
+ *            8 byte little-endian double, integer zigzag, unsigned integer
+ *            varint, boolean byte, string index
+ *
+ * Measurements, keys and values refer to the strings by index. Every
+ * string, series (measurement and tags) and shape (field keys and types)
+ * is stored once, so a point costs little more than its values. Nothing
+ * is aligned, a memory mapped batch is read in place byte by byte. */
+static const char LP_BATCH_MAGIC[8] = {'L', 'P', 'B', 'A', 'T', 'C', 'H', '1'};
+#define LP_BATCH_COUNTS 4
+#define LP_BATCH_SECTIONS 5
+/* Longest varint of a 64 bit value */
+#define LP_VARINT_SIZE 10
+
+static size_t
+put_varint(char *out, unsigned long long value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char)value;
+    return n;
+}
+
+/* Returns 0 if the varint is truncated or too long */
+static int
+get_varint(const char **in, const char *end, unsigned long long *value)
+{
+    const unsigned char *p = (const unsigned char *)*in;
+    unsigned long long result = 0;
+    int shift = 0;
+    while ((const char *)p < end && shift < 64) {
+        result |= (unsigned long long)(*p & 0x7f) << shift;
+        if (*p++ < 0x80) {
+            *in = (const char *)p;
+            *value = result;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+static unsigned long long
+zigzag(unsigned long long value)
+{
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+static unsigned long long
+unzigzag(unsigned long long value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+/* Growable output buffer */
+struct _LP_Output {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+static char*
+reserve(struct _LP_Output *output, size_t length)
+{
+    size_t capacity = output->capacity > 0 ? output->capacity : 256;
+    char *data = NULL;
+    while (capacity - output->length < length) {
+        capacity *= 2;
+    }
+    if (capacity != output->capacity) {
+        if ((data = LP_MALLOC(capacity)) == NULL) {
+            return NULL;
+        }
+        if (output->length > 0) {
+            memcpy(data, output->data, output->length);
+        }
+        LP_FREE(output->data);
+        output->data = data;
+        output->capacity = capacity;
+    }
+    return output->data + output->length;
+}
+
+/* Byte strings stored once and numbered in order of appearance. Open
+ * addressing on an FNV-1a hash. */
+struct _LP_Table {
+    struct _LP_Output data;
+    size_t *offsets; /* nr_keys + 1 into `data` */
+    size_t nr_keys;
+    size_t capacity;
+    size_t *slots; /* key index + 1, 0 is empty */
+    size_t nr_slots;
+};
+
+static unsigned long long
+hash_bytes(const char *data, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void
+free_table(struct _LP_Table *table)
+{
+    LP_FREE(table->data.data);
+    LP_FREE(table->offsets);
+    LP_FREE(table->slots);
+}
+
+static int
+grow_table(struct _LP_Table *table)
+{
+    size_t capacity = table->capacity > 0 ? 2 * table->capacity : 64;
+    size_t nr_slots = 2 * capacity;
+    size_t *offsets = NULL, *slots = NULL;
+    size_t i, slot;
+
+    offsets = LP_MALLOC((capacity + 1) * sizeof(*offsets));
+    slots = LP_MALLOC(nr_slots * sizeof(*slots));
+    if (offsets == NULL || slots == NULL) {
+        LP_FREE(offsets);
+        LP_FREE(slots);
+        return 0;
+    }
+    if (table->offsets == NULL) {
+        offsets[0] = 0;
+    } else {
+        memcpy(offsets, table->offsets, (table->nr_keys + 1) * sizeof(*offsets));
+    }
+    memset(slots, 0, nr_slots * sizeof(*slots));
+    for (i = 0; i < table->nr_keys; i++) {
+        slot = hash_bytes(table->data.data + offsets[i], offsets[i + 1] - offsets[i])
+            & (nr_slots - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (nr_slots - 1);
+        }
+        slots[slot] = i + 1;
+    }
+    LP_FREE(table->offsets);
+    LP_FREE(table->slots);
+    table->offsets = offsets;
+    table->slots = slots;
+    table->capacity = capacity;
+    table->nr_slots = nr_slots;
+    return 1;
+}
+
+/* Return the index of the key, adding it if needed, or -1 on memory
+ * error. */
+static long long
+intern(struct _LP_Table *table, const char *key, size_t length)
+{
+    size_t slot, index, start;
+    char *out = NULL;
+    if (table->nr_keys == table->capacity && !grow_table(table)) {
+        return -1;
+    }
+    slot = hash_bytes(key, length) & (table->nr_slots - 1);
+    while (table->slots[slot] != 0) {
+        index = table->slots[slot] - 1;
+        start = table->offsets[index];
+        if (table->offsets[index + 1] - start == length
+            && memcmp(table->data.data + start, key, length) == 0) {
+            return (long long)index;
+        }
+        slot = (slot + 1) & (table->nr_slots - 1);
+    }
+    if ((out = reserve(&table->data, length)) == NULL) {
+        return -1;
+    }
+    if (length > 0) {
+        memcpy(out, key, length);
+    }
+    table->data.length += length;
+    index = table->nr_keys++;
+    table->offsets[index + 1] = table->data.length;
+    table->slots[slot] = index + 1;
+    return (long long)index;
+}
+
+/* Append the string index of `str` to the key being built in `key` */
+static int
+put_string(struct _LP_Table *strings, struct _LP_Output *key, const char *str)
+{
+    long long index = intern(strings, str, strlen(str));
+    char *out = NULL;
+    if (index < 0 || (out = reserve(key, LP_VARINT_SIZE)) == NULL) {
+        return 0;
+    }
+    key->length += put_varint(out, (unsigned long long)index);
+    return 1;
+}
+
+static int
+put_number(struct _LP_Output *key, unsigned long long value)
+{
+    char *out = reserve(key, LP_VARINT_SIZE);
+    if (out == NULL) {
+        return 0;
+    }
+    key->length += put_varint(out, value);
+    return 1;
+}
+
+static int
+put_value(struct _LP_Table *strings, struct _LP_Output *output,
+          const struct LP_Item *field)
+{
+    unsigned long long bits = 0;
+    char *out = NULL;
+    int i;
+    switch (field->type) {
+        case LP_FLOAT:
+            if ((out = reserve(output, 8)) == NULL) {
+                return 0;
+            }
+            memcpy(&bits, &field->value.f, sizeof(bits));
+            for (i = 0; i < 8; i++) {
+                out[i] = (char)((bits >> (8 * i)) & 0xff);
+            }
+            output->length += 8;
+            return 1;
+        case LP_INTEGER:
+            return put_number(output, zigzag((unsigned long long)field->value.i));
+        case LP_UINTEGER:
+            return put_number(output, (unsigned long long)field->value.i);
+        case LP_BOOLEAN:
+            return put_number(output, field->value.b != 0);
+        default:
+            return put_string(strings, output, field->value.s);
+    }
+}
+
+/* Encode the linked list of points. Returns a buffer allocated with
+ * LP_MALLOC and its length, or NULL on memory error. */
+char*
+LP_dump_batch(const struct LP_Point *points, size_t *length)
+{
+    struct _LP_Table strings, series, shapes;
+    struct _LP_Output key, body, lengths;
+    const struct LP_Point *point = NULL;
+    const struct LP_Item *item = NULL;
+    unsigned long long counts[LP_BATCH_COUNTS];
+    unsigned long long sizes[LP_BATCH_SECTIONS];
+    unsigned long long time = 0;
+    long long series_index = 0, shape_index = 0;
+    size_t nr_points = 0, n = 0, i;
+    char *output = NULL, *out = NULL;
+
+    memset(&strings, 0, sizeof(strings));
+    memset(&series, 0, sizeof(series));
+    memset(&shapes, 0, sizeof(shapes));
+    memset(&key, 0, sizeof(key));
+    memset(&body, 0, sizeof(body));
+    memset(&lengths, 0, sizeof(lengths));
+    for (point = points; point != NULL; point = point->next_point) {
+        /* The series and shape keys are stored as they are encoded */
+        key.length = 0;
+        for (n = 0, item = point->tags; item != NULL; item = item->next_item) {
+            n++;
+        }
+        if (!put_string(&strings, &key, point->measurement) || !put_number(&key, n)) {
+            goto finally;
+        }
+        for (item = point->tags; item != NULL; item = item->next_item) {
+            if (!put_string(&strings, &key, item->key)
+                || !put_string(&strings, &key, item->value.s)) {
+                goto finally;
+            }
+        }
+        if ((series_index = intern(&series, key.data, key.length)) < 0) {
+            goto finally;
+        }
+        key.length = 0;
+        for (n = 0, item = point->fields; item != NULL; item = item->next_item) {
+            n++;
+        }
+        if (!put_number(&key, n)) {
+            goto finally;
+        }
+        for (item = point->fields; item != NULL; item = item->next_item) {
+            if (!put_string(&strings, &key, item->key)
+                || !put_number(&key, (unsigned long long)item->type)) {
+                goto finally;
+            }
+        }
+        if ((shape_index = intern(&shapes, key.data, key.length)) < 0) {
+            goto finally;
+        }
+        if (!put_number(&body, (unsigned long long)series_index)
+            || !put_number(&body, (unsigned long long)shape_index)
+            || !put_number(&body, zigzag(point->time - time))) {
+            goto finally;
+        }
+        time = point->time;
+        for (item = point->fields; item != NULL; item = item->next_item) {
+            if (!put_value(&strings, &body, item)) {
+                goto finally;
+            }
+        }
+        nr_points++;
+    }
+    for (i = 0; i < strings.nr_keys; i++) {
+        if (!put_number(&lengths, strings.offsets[i + 1] - strings.offsets[i])) {
+            goto finally;
+        }
+    }
+    counts[0] = strings.nr_keys;
+    counts[1] = series.nr_keys;
+    counts[2] = shapes.nr_keys;
+    counts[3] = nr_points;
+    sizes[0] = lengths.length;
+    sizes[1] = strings.data.length;
+    sizes[2] = series.data.length;
+    sizes[3] = shapes.data.length;
+    sizes[4] = body.length;
+    *length = sizeof(LP_BATCH_MAGIC) + (LP_BATCH_COUNTS + LP_BATCH_SECTIONS) * LP_VARINT_SIZE;
+    for (i = 0; i < LP_BATCH_SECTIONS; i++) {
+        *length += sizes[i];
+    }
+    if ((output = LP_MALLOC(*length)) == NULL) {
+        goto finally;
+    }
+    memcpy(output, LP_BATCH_MAGIC, sizeof(LP_BATCH_MAGIC));
+    out = output + sizeof(LP_BATCH_MAGIC);
+    for (i = 0; i < LP_BATCH_COUNTS; i++) {
+        out += put_varint(out, counts[i]);
+    }
+    for (i = 0; i < LP_BATCH_SECTIONS; i++) {
+        out += put_varint(out, sizes[i]);
+    }
+    if (lengths.length > 0) {
+        memcpy(out, lengths.data, lengths.length);
+        out += lengths.length;
+    }
+    if (strings.data.length > 0) {
+        memcpy(out, strings.data.data, strings.data.length);
+        out += strings.data.length;
+    }
+    if (series.data.length > 0) {
+        memcpy(out, series.data.data, series.data.length);
+        out += series.data.length;
+    }
+    if (shapes.data.length > 0) {
+        memcpy(out, shapes.data.data, shapes.data.length);
+        out += shapes.data.length;
+    }
+    if (body.length > 0) {
+        memcpy(out, body.data, body.length);
+        out += body.length;
+    }
+    *length = (size_t)(out - output);
+finally:
+    free_table(&strings);
+    free_table(&series);
+    free_table(&shapes);
+    LP_FREE(key.data);
+    LP_FREE(body.data);
+    LP_FREE(lengths.data);
+    return output;
+}
+
+/* Decode `nr` series or shapes from `data` into `starts` (nr + 1 indexes
+ * into `items`). A series is the measurement followed by a key and value
+ * per tag, a shape a key and type per field. Returns 0 if invalid. */
+static int
+read_items(const char *data, const char *end, size_t nr, int shapes,
+           size_t nr_strings, size_t *starts, size_t *items)
+{
+    unsigned long long value = 0, count = 0;
+    size_t i, j, n = 0;
+    for (i = 0; i < nr; i++) {
+        starts[i] = n;
+        if (!shapes) {
+            if (!get_varint(&data, end, &value) || value >= nr_strings) {
+                return 0;
+            }
+            items[n++] = (size_t)value;
+        }
+        /* Every item takes at least a byte, which bounds `count` */
+        if (!get_varint(&data, end, &count) || count > (size_t)(end - data)) {
+            return 0;
+        }
+        for (j = 0; j < 2 * count; j++) {
+            if (!get_varint(&data, end, &value)
+                || value >= ((shapes && j % 2) ? LP_STRING + 1 : nr_strings)) {
+                return 0;
+            }
+            items[n++] = (size_t)value;
+        }
+    }
+    starts[nr] = n;
+    return data == end;
+}
+
+void
+LP_close_batch(struct LP_BatchReader *reader)
+{
+    LP_FREE(reader->offsets);
+    LP_FREE(reader->series);
+    LP_FREE(reader->series_items);
+    LP_FREE(reader->shapes);
+    LP_FREE(reader->shape_items);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* Check the header, strings, series and shapes of an encoded batch and
+ * prepare to read its points. Returns 1 on success, 0 if the data is not
+ * a valid batch and -1 on memory error. Points are checked as they are
+ * read. Call LP_close_batch when done, also on failure. */
+int
+LP_open_batch(struct LP_BatchReader *reader, const char *data, size_t length)
+{
+    const char *end = data + length;
+    const char *sections[LP_BATCH_SECTIONS + 1];
+    unsigned long long counts[LP_BATCH_COUNTS];
+    unsigned long long sizes[LP_BATCH_SECTIONS];
+    unsigned long long value = 0;
+    size_t i, offset = 0;
+
+    memset(reader, 0, sizeof(*reader));
+    if (length < sizeof(LP_BATCH_MAGIC)
+        || memcmp(data, LP_BATCH_MAGIC, sizeof(LP_BATCH_MAGIC)) != 0) {
+        return 0;
+    }
+    data += sizeof(LP_BATCH_MAGIC);
+    for (i = 0; i < LP_BATCH_COUNTS; i++) {
+        if (!get_varint(&data, end, &counts[i])) {
+            return 0;
+        }
+    }
+    for (i = 0; i < LP_BATCH_SECTIONS; i++) {
+        if (!get_varint(&data, end, &sizes[i])) {
+            return 0;
+        }
+    }
+    sections[0] = data;
+    for (i = 0; i < LP_BATCH_SECTIONS; i++) {
+        if (sizes[i] > (size_t)(end - sections[i])) {
+            return 0;
+        }
+        sections[i + 1] = sections[i] + sizes[i];
+    }
+    /* Every string, series, shape and point takes at least a byte (three
+     * for a point), which bounds the allocations below */
+    if (sections[LP_BATCH_SECTIONS] != end || counts[0] > sizes[0]
+        || counts[1] > sizes[2] || counts[2] > sizes[3]
+        || counts[3] > sizes[4] / 3) {
+        return 0;
+    }
+    reader->nr_strings = (size_t)counts[0];
+    reader->nr_series = (size_t)counts[1];
+    reader->nr_shapes = (size_t)counts[2];
+    reader->nr_points = (size_t)counts[3];
+    reader->strings = sections[1];
+    reader->position = sections[4];
+    reader->end = end;
+
+    reader->offsets = LP_MALLOC((reader->nr_strings + 1) * sizeof(*reader->offsets));
+    reader->series = LP_MALLOC((reader->nr_series + 1) * sizeof(*reader->series));
+    reader->series_items = LP_MALLOC((sizes[2] + 1) * sizeof(*reader->series_items));
+    reader->shapes = LP_MALLOC((reader->nr_shapes + 1) * sizeof(*reader->shapes));
+    reader->shape_items = LP_MALLOC((sizes[3] + 1) * sizeof(*reader->shape_items));
+    if (reader->offsets == NULL || reader->series == NULL
+        || reader->series_items == NULL || reader->shapes == NULL
+        || reader->shape_items == NULL) {
+        return -1;
+    }
+    data = sections[0];
+    for (i = 0; i < reader->nr_strings; i++) {
+        reader->offsets[i] = offset;
+        if (!get_varint(&data, sections[1], &value) || value > sizes[1] - offset) {
+            return 0;
+        }
+        offset += (size_t)value;
+    }
+    reader->offsets[reader->nr_strings] = offset;
+    if (data != sections[1] || offset != sizes[1]) {
+        return 0;
+    }
+    if (!read_items(sections[2], sections[3], reader->nr_series, 0,
+                    reader->nr_strings, reader->series, reader->series_items)
+        || !read_items(sections[3], sections[4], reader->nr_shapes, 1,
+                       reader->nr_strings, reader->shapes, reader->shape_items)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* The string is not NUL-terminated */
+const char*
+LP_batch_string(const struct LP_BatchReader *reader, size_t index, size_t *length)
+{
+    *length = reader->offsets[index + 1] - reader->offsets[index];
+    return reader->strings + reader->offsets[index];
+}
+
+/* Describe a series: returns the number of tags and sets `tags` to the
+ * key and value string index of each */
+size_t
+LP_batch_series(const struct LP_BatchReader *reader, size_t index,
+                size_t *measurement, const size_t **tags)
+{
+    const size_t *items = reader->series_items + reader->series[index];
+    *measurement = items[0];
+    *tags = items + 1;
+    return (reader->series[index + 1] - reader->series[index] - 1) / 2;
+}
+
+/* Describe a shape: returns the number of fields and sets `fields` to the
+ * key string index and type of each */
+size_t
+LP_batch_shape(const struct LP_BatchReader *reader, size_t index,
+               const size_t **fields)
+{
+    *fields = reader->shape_items + reader->shapes[index];
+    return (reader->shapes[index + 1] - reader->shapes[index]) / 2;
+}
+
+/* Read the next point. Its field values follow, read them in order with
+ * LP_batch_next_value. Returns 1 for a point, 0 at the end and -1 if the
+ * data is invalid. */
+int
+LP_batch_next_point(struct LP_BatchReader *reader, struct LP_BatchPoint *point)
+{
+    unsigned long long series = 0, shape = 0, delta = 0;
+    if (reader->point == reader->nr_points) {
+        return reader->position == reader->end ? 0 : -1;
+    }
+    if (!get_varint(&reader->position, reader->end, &series)
+        || !get_varint(&reader->position, reader->end, &shape)
+        || !get_varint(&reader->position, reader->end, &delta)
+        || series >= reader->nr_series || shape >= reader->nr_shapes) {
+        return -1;
+    }
+    reader->point++;
+    reader->time += unzigzag(delta);
+    point->time = reader->time;
+    point->series = (size_t)series;
+    point->shape = (size_t)shape;
+    point->nr_tags = LP_batch_series(reader, point->series, &point->measurement,
+                                     &point->tags);
+    point->nr_fields = LP_batch_shape(reader, point->shape, &point->fields);
+    return 1;
+}
+
+/* Read the next field value of type `type`. For strings the string index
+ * is returned in `value->i`. Returns 0 if the data is invalid. */
+int
+LP_batch_next_value(struct LP_BatchReader *reader, enum LP_ValueType type,
+                    union LP_Value *value)
+{
+    const unsigned char *in = (const unsigned char *)reader->position;
+    unsigned long long raw = 0;
+    int i;
+    if (type == LP_FLOAT) {
+        if (reader->end - reader->position < 8) {
+            return 0;
+        }
+        for (i = 7; i >= 0; i--) {
+            raw = (raw << 8) | in[i];
+        }
+        memcpy(&value->f, &raw, sizeof(value->f));
+        reader->position += 8;
+        return 1;
+    }
+    if (!get_varint(&reader->position, reader->end, &raw)) {
+        return 0;
+    }
+    switch (type) {
+        case LP_INTEGER:
+            value->i = (signed long long)unzigzag(raw);
+            return 1;
+        case LP_UINTEGER:
+            value->i = (signed long long)raw;
+            return 1;
+        case LP_BOOLEAN:
+            value->b = raw != 0;
+            return raw <= 1;
+        default:
+            value->i = (signed long long)raw;
+            return raw < reader->nr_strings;
+    }
+}
+
+static char*
+copy_batch_string(const struct LP_BatchReader *reader, size_t index)
+{
+    size_t length = 0;
+    const char *str = LP_batch_string(reader, index, &length);
+    char *output = LP_MALLOC(length + 1);
+    if (output != NULL) {
+        memcpy(output, str, length);
+        output[length] = '\0';
+    }
+    return output;
+}
+
+/* Decode a batch into a linked list of points. Returns NULL with
+ * `status` LP_BATCH_ERROR for invalid data, LP_MEMORY_ERROR on memory
+ * error and 0 for an empty batch. */
+struct LP_Point*
+LP_load_batch(const char *data, size_t length, int *status)
+{
+    struct LP_BatchReader reader;
+    struct LP_BatchPoint record;
+    struct LP_Point *first = NULL, *point = NULL;
+    struct LP_Point **next_point = &first;
+    struct LP_Item *item = NULL, **next_item = NULL;
+    size_t j;
+    int result = 0;
+
+    *status = 0;
+    if ((result = LP_open_batch(&reader, data, length)) != 1) {
+        *status = result == 0 ? LP_BATCH_ERROR : LP_MEMORY_ERROR;
+        LP_close_batch(&reader);
+        return NULL;
+    }
+    while ((result = LP_batch_next_point(&reader, &record)) == 1) {
+        if ((point = LP_MALLOC(sizeof(*point))) == NULL) {
+            goto memory_error;
+        }
+        memset(point, 0, sizeof(*point));
+        *next_point = point;
+        next_point = &point->next_point;
+        point->time = record.time;
+        if ((point->measurement = copy_batch_string(&reader, record.measurement)) == NULL) {
+            goto memory_error;
+        }
+        next_item = &point->tags;
+        for (j = 0; j < record.nr_tags; j++) {
+            if ((item = LP_MALLOC(sizeof(*item))) == NULL) {
+                goto memory_error;
+            }
+            memset(item, 0, sizeof(*item));
+            item->type = LP_STRING;
+            *next_item = item;
+            next_item = &item->next_item;
+            if ((item->key = copy_batch_string(&reader, record.tags[2 * j])) == NULL
+                || (item->value.s = copy_batch_string(&reader, record.tags[2 * j + 1])) == NULL) {
+                goto memory_error;
+            }
+        }
+        next_item = &point->fields;
+        for (j = 0; j < record.nr_fields; j++) {
+            if ((item = LP_MALLOC(sizeof(*item))) == NULL) {
+                goto memory_error;
+            }
+            memset(item, 0, sizeof(*item));
+            *next_item = item;
+            next_item = &item->next_item;
+            item->type = (enum LP_ValueType)record.fields[2 * j + 1];
+            if (!LP_batch_next_value(&reader, item->type, &item->value)) {
+                item->type = LP_FLOAT;
+                result = -1;
+                break;
+            }
+            if (item->type == LP_STRING) {
+                if ((item->value.s = copy_batch_string(&reader, (size_t)item->value.i)) == NULL) {
+                    goto memory_error;
+                }
+            }
+            if ((item->key = copy_batch_string(&reader, record.fields[2 * j])) == NULL) {
+                goto memory_error;
+            }
+        }
+        if (result < 0) {
+            break;
+        }
+    }
+    LP_close_batch(&reader);
+    if (result < 0) {
+        LP_free_point(first);
+        *status = LP_BATCH_ERROR;
+        return NULL;
+    }
+    return first;
+memory_error:
+    LP_close_batch(&reader);
+    LP_free_point(first);
+    *status = LP_MEMORY_ERROR;
+    return NULL;
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_protocol_parser.h"
+
+/* (Used to override malloc/free in Python C extension) */
+#ifndef LP_MALLOC
+#define LP_MALLOC malloc
+#endif
+#ifndef LP_FREE
+#define LP_FREE free
+#endif
+
+int
+LP_init_line_buffer(struct LP_LineBuffer *buffer, size_t size)
+{
+    buffer->size = size > 0 ? size : 1;
+    buffer->start = 0;
+    buffer->end = 0;
+    buffer->max_size = 0;
+    buffer->skipping = 0;
+    buffer->too_long = 0;
+    buffer->data = LP_MALLOC(buffer->size);
+    return buffer->data != NULL;
+}
+
+void
+LP_free_line_buffer(struct LP_LineBuffer *buffer)
+{
+    LP_FREE(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->start = 0;
+    buffer->end = 0;
+}
+
+/* Return where the next chunk of input should be written. The unread part
+ * is moved to the front of the buffer first. The buffer only grows when a
+ * single line does not fit, and never beyond `max_size`. A line filling a
+ * buffer of `max_size` is dropped. */
+char*
+LP_line_buffer_space(struct LP_LineBuffer *buffer, size_t *space)
+{
+    char *data = NULL;
+    size_t used = buffer->end - buffer->start;
+    size_t size = 2 * buffer->size;
+    if (buffer->end == buffer->size) {
+        if (buffer->skipping) {
+            used = 0;
+        } else if (buffer->start > 0) {
+            memmove(buffer->data, buffer->data + buffer->start, used);
+        } else if (buffer->max_size > 0 && buffer->size >= buffer->max_size) {
+            buffer->skipping = 1;
+            buffer->too_long++;
+            used = 0;
+        } else {
+            if (buffer->max_size > 0 && size > buffer->max_size) {
+                size = buffer->max_size;
+            }
+            if ((data = LP_MALLOC(size)) == NULL) {
+                return NULL;
+            }
+            memcpy(data, buffer->data, used);
+            LP_FREE(buffer->data);
+            buffer->data = data;
+            buffer->size = size;
+        }
+        buffer->start = 0;
+        buffer->end = used;
+    }
+    *space = buffer->size - buffer->end;
+    return buffer->data + buffer->end;
+}
+
+void
+LP_line_buffer_commit(struct LP_LineBuffer *buffer, size_t length)
+{
+    buffer->end += length;
+}
+
+/* Take the next complete line out of the buffer. When `final` is set the
+ * input has ended and a last line without terminator is returned too.
+ * The line stays valid until the buffer is written to again. */
+int
+LP_line_buffer_next(struct LP_LineBuffer *buffer, int final,
+                    const char **line, size_t *length)
+{
+    const char *start = buffer->data + buffer->start;
+    size_t used = buffer->end - buffer->start;
+    size_t next = 0;
+    const char *newline = NULL;
+    if (buffer->skipping && used > 0) {
+        if ((newline = memchr(start, '\n', used)) == NULL) {
+            buffer->start = 0;
+            buffer->end = 0;
+            return 0;
+        }
+        buffer->skipping = 0;
+        buffer->start += newline + 1 - start;
+        start = newline + 1;
+        used = buffer->end - buffer->start;
+    }
+    if (used == 0) {
+        buffer->start = 0;
+        buffer->end = 0;
+        return 0;
+    }
+    *length = LP_next_line(start, used, &next);
+    if (!final && start[next - 1] != '\n') {
+        /* Wait for the rest of the line */
+        return 0;
+    }
+    *line = start;
+    buffer->start += next;
+    if (buffer->start == buffer->end) {
+        buffer->start = 0;
+        buffer->end = 0;
+    }
+    return 1;
+}
@@ -339,16 +339,19 @@ parse_value(struct LP_Item* item)
     return 0; // Error
 }
 
-struct LP_Point*
-LP_parse_line(const char *line, int *status)
+/* Parse the first `end` characters of `line`. The line does not have to
+ * be NUL-terminated at `end`. */
+static struct LP_Point*
+parse_line(const char *line, size_t end, int *status)
 {
     struct LP_Point *point = NULL;
     struct LP_Item *item = NULL;
     struct LP_Item *prev_item = NULL;
+    char time_buffer[32];
+    char *time_str = NULL;
     char *endptr_time = NULL;
     size_t index = 0;
     size_t start = 0;
-    size_t end = strlen(line);
     if (end == 0) {
         // Zero length line
         *status = LP_LINE_EMPTY;
@@ -376,7 +379,7 @@ LP_parse_line(const char *line, int *status)
     LP_DEBUG_PRINT("Measurement: %s\n", point->measurement);
 
     /* Extract all tags available */
-    while (line[index] == ','){
+    while (index < end && line[index] == ','){
         if ((item = new_item()) == NULL) {
             // Failed to create new tag item
             *status = LP_MEMORY_ERROR;
@@ -466,7 +469,7 @@ LP_parse_line(const char *line, int *status)
         }
 
         prev_item = item;
-    } while (line[index] == ',');
+    } while (index < end && line[index] == ',');
     // Hook the chain of fields to the point
     if (item != NULL) {
         point->fields = item;
@@ -476,7 +479,16 @@ LP_parse_line(const char *line, int *status)
     if(start >= end) {
         point->time = 0;
     } else {
-        point->time = strtoull(line + start, &endptr_time, 10);
+        /* strtoull needs a terminated string, which `line` might not be */
+        if (end - start < sizeof(time_buffer)) {
+            time_str = time_buffer;
+        } else if ((time_str = LP_MALLOC(end - start + 1)) == NULL) {
+            *status = LP_MEMORY_ERROR;
+            goto error;
+        }
+        memcpy(time_str, line + start, end - start);
+        time_str[end - start] = '\0';
+        point->time = strtoull(time_str, &endptr_time, 10);
         LP_DEBUG_PRINT("Time: %llu\n", point->time);
         if (*endptr_time != '\0' && *endptr_time != '\n' && *endptr_time != '\r') {
             // Failed to parse whole nanosecond timestamp
@@ -489,10 +501,94 @@ error:
     LP_free_point(point);
     point = NULL;
 done:
+    if (time_str != time_buffer) {
+        LP_FREE(time_str);
+    }
     LP_DEBUG_PRINT("RETURN STATUS: %d\n", *status);
     return point;
 }
 
+struct LP_Point*
+LP_parse_line(const char *line, int *status)
+{
+    return parse_line(line, strlen(line), status);
+}
+
+struct LP_Point*
+LP_parse_line_n(const char *line, size_t length, int *status)
+{
+    return parse_line(line, length, status);
+}
+
+/* Return the length of the line starting at `data`, excluding the line
+ * terminator. The offset of the following line is written to `next`. */
+size_t
+LP_next_line(const char *data, size_t length, size_t *next)
+{
+    const char *newline = memchr(data, '\n', length);
+    size_t line_length = length;
+    if (newline == NULL) {
+        *next = length;
+    } else {
+        line_length = newline - data;
+        *next = line_length + 1;
+    }
+    if (line_length > 0 && data[line_length - 1] == '\r') {
+        line_length--;
+    }
+    return line_length;
+}
+
+/* Lines with only whitespace, or starting with "#", carry no point */
+int
+LP_is_blank_line(const char *line, size_t length)
+{
+    size_t i;
+    for (i = 0; i < length; i++) {
+        if (line[i] == '#') {
+            return 1;
+        }
+        if (!isspace((unsigned char)line[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+struct LP_Point*
+LP_parse_lines(const char *data, size_t length, int *status, size_t *lineno)
+{
+    struct LP_Point *first = NULL;
+    struct LP_Point *last = NULL;
+    struct LP_Point *point = NULL;
+    size_t offset = 0;
+    size_t next = 0;
+    size_t line_length = 0;
+    *status = 0;
+    *lineno = 0;
+    while (offset < length) {
+        line_length = LP_next_line(data + offset, length - offset, &next);
+        (*lineno)++;
+        if (!LP_is_blank_line(data + offset, line_length)) {
+            if ((point = parse_line(data + offset, line_length, status)) == NULL) {
+                LP_free_point(first);
+                return NULL;
+            }
+            if (last == NULL) {
+                first = point;
+            } else {
+                last->next_point = point;
+            }
+            last = point;
+        }
+        offset += next;
+    }
+    if (first == NULL) {
+        *status = LP_LINE_EMPTY;
+    }
+    return first;
+}
+
 #ifndef NDEBUG
 
 static int
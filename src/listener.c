@@ -0,0 +1,578 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_protocol_parser.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+/* (Used to override malloc/free in Python C extension) */
+#ifndef LP_MALLOC
+#define LP_MALLOC malloc
+#endif
+#ifndef LP_FREE
+#define LP_FREE free
+#endif
+
+/* Length of a datagram which did not fit in `datagram_size` */
+#define LP_TRUNCATED ((size_t)-1)
+
+/* Points parsed from one receive call (or one fed chunk) */
+struct _LP_Batch {
+    struct LP_Point *points;
+    size_t nr_points;
+};
+
+struct LP_Listener {
+    int fd;
+    int stream;
+    int wake[2];
+    int block;
+    size_t max_batch;
+    size_t datagram_size;
+    size_t max_queue;
+    char *datagrams;
+#ifdef __linux__
+    struct mmsghdr *messages;
+    struct iovec *vectors;
+#endif
+    struct LP_LineBuffer buffer;
+    pthread_t thread;
+    int started;
+    int receiving;
+    int closed;
+    /* errno that stopped the receiver, 0 if none */
+    int error;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    /* Ring of `max_queue` batches */
+    struct _LP_Batch *queue;
+    size_t head;
+    size_t count;
+    /* Slots held by feeds that are still parsing */
+    size_t reserved;
+    struct LP_ListenerStats stats;
+};
+
+/* Parse the complete lines of `data`, skipping lines that fail. The
+ * points are appended to `batch`. Returns the number of bad lines. */
+static unsigned long long
+parse_lines(const char *data, size_t length, struct _LP_Batch *batch,
+            struct LP_Point **last)
+{
+    struct LP_Point *point = NULL;
+    unsigned long long errors = 0;
+    size_t offset = 0, next = 0, line_length = 0;
+    int status = 0;
+    while (offset < length) {
+        line_length = LP_next_line(data + offset, length - offset, &next);
+        if (!LP_is_blank_line(data + offset, line_length)) {
+            if ((point = LP_parse_line_n(data + offset, line_length, &status)) == NULL) {
+                errors++;
+            } else {
+                if (*last == NULL) {
+                    batch->points = point;
+                } else {
+                    (*last)->next_point = point;
+                }
+                *last = point;
+                batch->nr_points++;
+            }
+        }
+        offset += next;
+    }
+    return errors;
+}
+
+/* Deadline `timeout_ms` from now, for pthread_cond_timedwait */
+static void
+get_deadline(long timeout_ms, struct timespec *deadline)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    deadline->tv_sec = now.tv_sec + timeout_ms / 1000;
+    deadline->tv_nsec = now.tv_usec * 1000L + (timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static int
+queue_full(struct LP_Listener *listener)
+{
+    return listener->count + listener->reserved >= listener->max_queue;
+}
+
+/* Queue a batch, or drop it if there is no room. `has_room` is set when a
+ * slot was reserved for it. Called with the mutex held. */
+static struct LP_Point*
+put_batch(struct LP_Listener *listener, struct _LP_Batch *batch, int has_room)
+{
+    if (batch->nr_points == 0) {
+        return NULL;
+    }
+    if (!has_room || listener->closed) {
+        listener->stats.dropped += batch->nr_points;
+        return batch->points;
+    }
+    listener->queue[(listener->head + listener->count) % listener->max_queue] = *batch;
+    listener->count++;
+    listener->stats.points += batch->nr_points;
+    pthread_cond_signal(&listener->not_empty);
+    return NULL;
+}
+
+/* Hand a batch over to the queue. Waits for room if the listener blocks,
+ * otherwise the batch is dropped when the queue is full. */
+static void
+enqueue(struct LP_Listener *listener, struct _LP_Batch *batch,
+        unsigned long long reads, unsigned long long bytes, unsigned long long errors)
+{
+    struct LP_Point *drop = NULL;
+    pthread_mutex_lock(&listener->mutex);
+    listener->stats.reads += reads;
+    listener->stats.bytes += bytes;
+    listener->stats.errors += errors;
+    if (batch->nr_points > 0 && listener->block && !listener->closed
+        && queue_full(listener)) {
+        listener->stats.blocked++;
+        while (queue_full(listener) && !listener->closed) {
+            pthread_cond_wait(&listener->not_full, &listener->mutex);
+        }
+    }
+    drop = put_batch(listener, batch, !queue_full(listener));
+    pthread_mutex_unlock(&listener->mutex);
+    LP_free_point(drop);
+}
+
+/* Receive up to `max_batch` datagrams with as few system calls as
+ * possible. Returns the number received, 0 if none were ready and -1 on
+ * error. */
+static int
+receive_datagrams(struct LP_Listener *listener, size_t *lengths)
+{
+#ifdef __linux__
+    struct mmsghdr *messages = listener->messages;
+    size_t i;
+    int n = 0;
+    for (i = 0; i < listener->max_batch; i++) {
+        messages[i].msg_hdr.msg_flags = 0;
+        messages[i].msg_len = 0;
+    }
+    n = recvmmsg(listener->fd, messages, listener->max_batch, MSG_DONTWAIT, NULL);
+    for (i = 0; n > 0 && i < (size_t)n; i++) {
+        lengths[i] = messages[i].msg_len;
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            lengths[i] = LP_TRUNCATED;
+        }
+    }
+#else
+    struct msghdr message;
+    struct iovec vector;
+    ssize_t length = 0;
+    int n = 0;
+    while ((size_t)n < listener->max_batch) {
+        /* recv() can't tell a truncated datagram, recvmsg() sets MSG_TRUNC */
+        memset(&message, 0, sizeof(message));
+        vector.iov_base = listener->datagrams + n * listener->datagram_size;
+        vector.iov_len = listener->datagram_size;
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        length = recvmsg(listener->fd, &message, MSG_DONTWAIT);
+        if (length < 0) {
+            break;
+        }
+        lengths[n++] = (message.msg_flags & MSG_TRUNC) ? LP_TRUNCATED : (size_t)length;
+    }
+    if (n == 0 && length < 0) {
+        n = -1;
+    }
+#endif
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    return n;
+}
+
+static int
+receive_datagram_batch(struct LP_Listener *listener, size_t *lengths)
+{
+    struct _LP_Batch batch = {NULL, 0};
+    struct LP_Point *last = NULL;
+    unsigned long long bytes = 0, errors = 0;
+    int i, n;
+    if ((n = receive_datagrams(listener, lengths)) <= 0) {
+        return n;
+    }
+    for (i = 0; i < n; i++) {
+        if (lengths[i] == LP_TRUNCATED) {
+            /* The last line is cut off, count the datagram as an error */
+            errors++;
+            continue;
+        }
+        bytes += lengths[i];
+        errors += parse_lines(listener->datagrams + i * listener->datagram_size,
+                              lengths[i], &batch, &last);
+    }
+    enqueue(listener, &batch, n, bytes, errors);
+    return n;
+}
+
+/* Read from a stream socket, parse the lines completed by the read. Returns
+ * 0 at end of stream. */
+static int
+receive_stream(struct LP_Listener *listener)
+{
+    struct _LP_Batch batch = {NULL, 0};
+    struct LP_Point *last = NULL;
+    unsigned long long errors = 0;
+    unsigned long long too_long = listener->buffer.too_long;
+    const char *line = NULL;
+    char *space_ptr = NULL;
+    size_t space = 0, line_length = 0;
+    ssize_t length = 0;
+    if ((space_ptr = LP_line_buffer_space(&listener->buffer, &space)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    length = recv(listener->fd, space_ptr, space, MSG_DONTWAIT);
+    if (length < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 1 : -1;
+    }
+    LP_line_buffer_commit(&listener->buffer, (size_t)length);
+    while (LP_line_buffer_next(&listener->buffer, length == 0, &line, &line_length)) {
+        errors += parse_lines(line, line_length, &batch, &last);
+    }
+    errors += listener->buffer.too_long - too_long;
+    enqueue(listener, &batch, 1, (unsigned long long)length, errors);
+    return length > 0;
+}
+
+static void*
+receive_loop(void *arg)
+{
+    struct LP_Listener *listener = arg;
+    struct pollfd fds[2];
+    size_t *lengths = NULL;
+    int result = 0;
+    int error = 0;
+
+    if (!listener->stream
+        && (lengths = LP_MALLOC(listener->max_batch * sizeof(*lengths))) == NULL) {
+        error = ENOMEM;
+        result = -1;
+    }
+    fds[0].fd = listener->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = listener->wake[0];
+    fds[1].events = POLLIN;
+    while (result >= 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (!fds[0].revents) {
+            continue;
+        }
+        if (listener->stream) {
+            if ((result = receive_stream(listener)) == 0) {
+                break;
+            }
+        } else {
+            result = receive_datagram_batch(listener, lengths);
+        }
+        if (result < 0) {
+            error = errno;
+        }
+    }
+    LP_FREE(lengths);
+    pthread_mutex_lock(&listener->mutex);
+    listener->receiving = 0;
+    listener->error = error;
+    pthread_cond_broadcast(&listener->not_empty);
+    pthread_mutex_unlock(&listener->mutex);
+    return NULL;
+}
+
+struct LP_Listener*
+LP_new_listener(int fd, size_t max_batch, size_t datagram_size, size_t max_queue,
+                int block)
+{
+    struct LP_Listener *listener = NULL;
+    int type = 0;
+    socklen_t type_length = sizeof(type);
+    size_t i;
+
+    if (max_batch == 0 || datagram_size == 0 || max_queue == 0
+        || max_batch > LP_LISTENER_MAX_BATCH || datagram_size > INT_MAX
+        || datagram_size > SIZE_MAX / max_batch
+        || max_queue > SIZE_MAX / sizeof(struct _LP_Batch)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((listener = LP_MALLOC(sizeof(*listener))) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(listener, 0, sizeof(*listener));
+    listener->fd = fd;
+    listener->wake[0] = -1;
+    listener->wake[1] = -1;
+    listener->block = block;
+    listener->max_batch = max_batch;
+    listener->datagram_size = datagram_size;
+    listener->max_queue = max_queue;
+    pthread_mutex_init(&listener->mutex, NULL);
+    pthread_cond_init(&listener->not_empty, NULL);
+    pthread_cond_init(&listener->not_full, NULL);
+    if ((listener->queue = LP_MALLOC(max_queue * sizeof(*listener->queue))) == NULL) {
+        errno = ENOMEM;
+        goto error;
+    }
+    if (fd < 0) {
+        /* Only fed through LP_listener_feed */
+        return listener;
+    }
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_length) < 0) {
+        goto error;
+    }
+    listener->stream = (type == SOCK_STREAM);
+    if (listener->stream) {
+        if (!LP_init_line_buffer(&listener->buffer, datagram_size)) {
+            errno = ENOMEM;
+            goto error;
+        }
+        listener->buffer.max_size = datagram_size > LP_LISTENER_MAX_LINE
+            ? datagram_size : LP_LISTENER_MAX_LINE;
+    } else if ((listener->datagrams = LP_MALLOC(max_batch * datagram_size)) == NULL) {
+        errno = ENOMEM;
+        goto error;
+    }
+#ifdef __linux__
+    if (!listener->stream) {
+        listener->messages = LP_MALLOC(max_batch * sizeof(*listener->messages));
+        listener->vectors = LP_MALLOC(max_batch * sizeof(*listener->vectors));
+        if (listener->messages == NULL || listener->vectors == NULL) {
+            errno = ENOMEM;
+            goto error;
+        }
+        memset(listener->messages, 0, max_batch * sizeof(*listener->messages));
+        for (i = 0; i < max_batch; i++) {
+            listener->vectors[i].iov_base = listener->datagrams + i * datagram_size;
+            listener->vectors[i].iov_len = datagram_size;
+            listener->messages[i].msg_hdr.msg_iov = &listener->vectors[i];
+            listener->messages[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+#endif
+    if (pipe(listener->wake) < 0) {
+        goto error;
+    }
+    listener->receiving = 1;
+    if ((errno = pthread_create(&listener->thread, NULL, receive_loop, listener)) != 0) {
+        listener->receiving = 0;
+        goto error;
+    }
+    listener->started = 1;
+    return listener;
+error:
+    type = errno;
+    LP_free_listener(listener);
+    errno = type;
+    return NULL;
+}
+
+/* Parse `data` and queue it as one batch. When the queue is full and the
+ * listener blocks, waits at most `timeout_ms` (forever if negative) for
+ * room first. Sets `*status` to LP_LISTENER_TIMEOUT if there was none,
+ * nothing is parsed then. Start with `*status` 0, calling again after
+ * LP_LISTENER_TIMEOUT continues the wait (counted once in `blocked`). */
+void
+LP_listener_feed(struct LP_Listener *listener, const char *data, size_t length,
+                 long timeout_ms, int *status)
+{
+    struct _LP_Batch batch = {NULL, 0};
+    struct LP_Point *last = NULL;
+    struct LP_Point *drop = NULL;
+    struct timespec deadline;
+    unsigned long long errors = 0;
+    int has_room = 0, waited = 0;
+
+    if (timeout_ms >= 0) {
+        get_deadline(timeout_ms, &deadline);
+    }
+    pthread_mutex_lock(&listener->mutex);
+    while (listener->block && !listener->closed && queue_full(listener)) {
+        if (*status != LP_LISTENER_TIMEOUT) {
+            listener->stats.blocked++;
+            *status = LP_LISTENER_TIMEOUT;
+        }
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&listener->not_full, &listener->mutex);
+        } else if (waited == ETIMEDOUT) {
+            pthread_mutex_unlock(&listener->mutex);
+            return;
+        } else {
+            waited = pthread_cond_timedwait(&listener->not_full, &listener->mutex,
+                                            &deadline);
+        }
+    }
+    *status = 0;
+    /* Hold the slot while parsing, so the receiver can't take it */
+    if ((has_room = !queue_full(listener))) {
+        listener->reserved++;
+    }
+    pthread_mutex_unlock(&listener->mutex);
+
+    errors = parse_lines(data, length, &batch, &last);
+
+    pthread_mutex_lock(&listener->mutex);
+    if (has_room) {
+        listener->reserved--;
+        if (batch.nr_points == 0) {
+            pthread_cond_signal(&listener->not_full);
+        }
+    }
+    listener->stats.reads++;
+    listener->stats.bytes += length;
+    listener->stats.errors += errors;
+    drop = put_batch(listener, &batch, has_room);
+    pthread_mutex_unlock(&listener->mutex);
+    LP_free_point(drop);
+}
+
+/* Wait at most `timeout_ms` (forever if negative) for the next batch.
+ * Returns NULL with `*status` set to LP_LISTENER_TIMEOUT, or when drained
+ * to LP_LISTENER_ERROR if the receiver failed (see LP_listener_error),
+ * otherwise to LP_LISTENER_CLOSED once closed. */
+struct LP_Point*
+LP_listener_get(struct LP_Listener *listener, long timeout_ms, int *status)
+{
+    struct LP_Point *output = NULL;
+    struct timespec deadline;
+    int waited = 0;
+
+    if (timeout_ms >= 0) {
+        get_deadline(timeout_ms, &deadline);
+    }
+    *status = 0;
+    pthread_mutex_lock(&listener->mutex);
+    while (listener->count == 0) {
+        if (listener->error != 0) {
+            *status = LP_LISTENER_ERROR;
+            break;
+        }
+        if (listener->closed || (listener->started && !listener->receiving)) {
+            *status = LP_LISTENER_CLOSED;
+            break;
+        }
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&listener->not_empty, &listener->mutex);
+        } else if (waited == ETIMEDOUT) {
+            *status = LP_LISTENER_TIMEOUT;
+            break;
+        } else {
+            waited = pthread_cond_timedwait(&listener->not_empty, &listener->mutex,
+                                            &deadline);
+        }
+    }
+    if (listener->count > 0) {
+        output = listener->queue[listener->head].points;
+        listener->head = (listener->head + 1) % listener->max_queue;
+        listener->count--;
+        pthread_cond_signal(&listener->not_full);
+    }
+    pthread_mutex_unlock(&listener->mutex);
+    return output;
+}
+
+/* errno of the failure that stopped the receiver thread, 0 if none */
+int
+LP_listener_error(struct LP_Listener *listener)
+{
+    int error = 0;
+    pthread_mutex_lock(&listener->mutex);
+    error = listener->error;
+    pthread_mutex_unlock(&listener->mutex);
+    return error;
+}
+
+void
+LP_listener_stats(struct LP_Listener *listener, struct LP_ListenerStats *stats)
+{
+    pthread_mutex_lock(&listener->mutex);
+    *stats = listener->stats;
+    stats->queued = listener->count;
+    pthread_mutex_unlock(&listener->mutex);
+}
+
+/* Stop receiving. Queued batches can still be taken with LP_listener_get. */
+void
+LP_close_listener(struct LP_Listener *listener)
+{
+    char byte = 0;
+    pthread_mutex_lock(&listener->mutex);
+    listener->closed = 1;
+    pthread_cond_broadcast(&listener->not_empty);
+    pthread_cond_broadcast(&listener->not_full);
+    pthread_mutex_unlock(&listener->mutex);
+    if (listener->started) {
+        while (write(listener->wake[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+        pthread_join(listener->thread, NULL);
+        listener->started = 0;
+    }
+}
+
+void
+LP_free_listener(struct LP_Listener *listener)
+{
+    if (listener == NULL) {
+        return;
+    }
+    LP_close_listener(listener);
+    while (listener->count > 0) {
+        LP_free_point(listener->queue[listener->head].points);
+        listener->head = (listener->head + 1) % listener->max_queue;
+        listener->count--;
+    }
+    if (listener->wake[0] >= 0) {
+        close(listener->wake[0]);
+        close(listener->wake[1]);
+    }
+    pthread_cond_destroy(&listener->not_empty);
+    pthread_cond_destroy(&listener->not_full);
+    pthread_mutex_destroy(&listener->mutex);
+    LP_free_line_buffer(&listener->buffer);
+    LP_FREE(listener->datagrams);
+#ifdef __linux__
+    LP_FREE(listener->messages);
+    LP_FREE(listener->vectors);
+#endif
+    LP_FREE(listener->queue);
+    LP_FREE(listener);
+}
+
+#endif
@@ -10,6 +10,15 @@ PyDoc_STRVAR(module_doc,
 \n\
 Functions:\n\
 parse_line(line) -> dict.\n\
+dump_batch(data) -> bytes.\n\
+load_batch(data) -> list.\n\
+build_index(path, block_size=1048576) -> int.\n\
+parse_file(path, start=None, end=None) -> list.\n\
+\n\
+Classes:\n\
+Aggregator (downsample lines into per-series time buckets).\n\
+Reader (iterate over points of a possibly compressed stream).\n\
+Listener (receive and parse UDP/TCP input on a background thread).\n\
 \n\
 Exceptions:\n\
 LineFormatError (raised when a line protocol string is wrong).\n\
@@ -22,78 +31,100 @@ PyDoc_STRVAR(LineFormatError__doc__,
 static PyObject *LineFormatError = NULL;
 
 
-PyDoc_STRVAR(parse_line__doc__,
-"Parse a line protocol string into a dictionary.\n\
-\n\
-Returns a dictionary with keys 'measurement', 'fields', 'tags' and\n\
-'time'. Rases `LineFormatError` when input can't be parsed.\n\
-");
+/* Set a Python exception based on a `LP_parse_line` status code */
+static void
+set_parse_error(int status)
+{
+    switch(status) {
+        case LP_MEMORY_ERROR:
+            PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory.");
+            break;
+        case LP_LINE_EMPTY:
+            PyErr_SetString(LineFormatError, "Line is empty string.");
+            break;
+        case LP_MEASUREMENT_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse measurement.");
+            break;
+        case LP_SET_KEY_ERROR:
+            PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory for key string.");
+            break;
+        case LP_SET_VALUE_ERROR:
+            PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory for value string.");
+            break;
+        case LP_TAG_KEY_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse key of tag.");
+            break;
+        case LP_TAG_VALUE_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse value of tag.");
+            break;
+        case LP_FIELD_KEY_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse key of field.");
+            break;
+        case LP_FIELD_VALUE_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse value of field.");
+            break;
+        case LP_FIELD_VALUE_TYPE_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse type of field value.");
+            break;
+        case LP_TIME_ERROR:
+            PyErr_SetString(LineFormatError, "Failed to parse nanoseconds integer timestamp.");
+            break;
+        default:
+            PyErr_SetString(LineFormatError, "Failed to parse line.");
+            break;
+    }
+}
+
+/* Same as `set_parse_error` but tells where in a batch it failed, e.g.
+ * "(line 3)" */
+static void
+set_parse_error_at(int status, const char *where, unsigned long long position)
+{
+    PyObject *type = NULL, *value = NULL, *traceback = NULL;
+    set_parse_error(status);
+    if (!PyErr_ExceptionMatches(LineFormatError)) {
+        return;
+    }
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_Format(LineFormatError, "%S (%s %llu)", value, where, position);
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
+}
 
+/* Borrow a char buffer from a str or bytes-like object. The returned
+ * object owns the buffer and must be released by the caller. */
 static PyObject*
-parse_line(PyObject* self, PyObject* args)
+get_bytes(PyObject *obj, const char **data, Py_ssize_t *length)
+{
+    PyObject *input = NULL;
+    if (PyBytes_Check(obj)) {
+        input = obj;
+        Py_INCREF(input);
+    } else if (PyUnicode_Check(obj)) {
+        if ((input = PyUnicode_AsEncodedString(obj, NULL, NULL)) == NULL) {
+            return NULL;
+        }
+    } else if ((input = PyBytes_FromObject(obj)) == NULL) {
+        return NULL;
+    }
+    *data = PyBytes_AS_STRING(input);
+    *length = PyBytes_GET_SIZE(input);
+    return input;
+}
+
+/* Convert a single point (ignoring `next_point`) to a dictionary */
+static PyObject*
+point_to_dict(const struct LP_Point *point)
 {
     PyObject *measurement = NULL;
     PyObject *tag_value = NULL;
     PyObject *field_value = NULL;
     PyObject *tags = NULL, *fields = NULL;
     PyObject *time = NULL;
-    PyObject *input = NULL, *output = NULL;
-    struct LP_Item *tmp = NULL;
-    struct LP_Point *point = NULL;
-    char *line = NULL;
-    int status = 0;
-    goto try;
-try:
-    assert(!PyErr_Occurred());
-    assert(args);
-    if (PyBytes_Check(args)) {
-        input = args;
-        Py_INCREF(input);
-    } else if ((input = PyUnicode_AsEncodedString(args, NULL, NULL)) == NULL) {
-        return NULL;
-    }
-    if ((line = PyBytes_AsString(input)) == NULL) {
-        return NULL;
-    }
-    point = LP_parse_line(line, &status);
-    // Check status and raise exception based on status
-    if (point == NULL) {
-        switch(status) {
-            case LP_MEMORY_ERROR:
-                PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory.");
-                goto except;
-            case LP_LINE_EMPTY:
-                PyErr_SetString(LineFormatError, "Line is empty string.");
-                goto except;
-            case LP_MEASUREMENT_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse measurement.");
-                goto except;
-            case LP_SET_KEY_ERROR:
-                PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory for key string.");
-                goto except;
-            case LP_SET_VALUE_ERROR:
-                PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory for value string.");
-                goto except;
-            case LP_TAG_KEY_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse key of tag.");
-                goto except;
-            case LP_TAG_VALUE_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse value of tag.");
-                goto except;
-            case LP_FIELD_KEY_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse key of field.");
-                goto except;
-            case LP_FIELD_VALUE_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse value of field.");
-                goto except;
-            case LP_FIELD_VALUE_TYPE_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse type of field value.");
-                goto except;
-            case LP_TIME_ERROR:
-                PyErr_SetString(LineFormatError, "Failed to parse nanoseconds integer timestamp.");
-                goto except;
-        }
-    }
+    PyObject *output = NULL;
+    const struct LP_Item *tmp = NULL;
+
     if ((measurement = PyUnicode_FromString(point->measurement)) == NULL) {
         goto except;
     }
@@ -109,40 +140,43 @@ try:
             goto except;
         }
         Py_DECREF(tag_value);
+        tag_value = NULL;
         tmp = tmp->next_item;
     }
     if ((fields = PyDict_New()) == NULL) {
         goto except;
     }
     tmp = point->fields;
-    if (tmp != NULL) {
-        while (tmp != NULL) {
-            switch (tmp->type) {
-                case LP_FLOAT:
-                    field_value = PyFloat_FromDouble(tmp->value.f);
-                    break;
-                case LP_INTEGER:
-                    field_value = PyLong_FromLongLong(tmp->value.i);
-                    break;
-                case LP_UINTEGER:
-                    field_value = PyLong_FromUnsignedLongLong(tmp->value.i);
-                    break;
-                case LP_BOOLEAN:
-                    field_value = PyBool_FromLong(tmp->value.b);
-                    break;
-                case LP_STRING:
-                    field_value = PyUnicode_FromString(tmp->value.s);
-                    break;
-                default:
-                    PyErr_SetString(LineFormatError, "Unexpected value type.");
-                    goto except;
-            }
-            if ((PyDict_SetItemString(fields, tmp->key, field_value)) == -1) {
+    while (tmp != NULL) {
+        switch (tmp->type) {
+            case LP_FLOAT:
+                field_value = PyFloat_FromDouble(tmp->value.f);
+                break;
+            case LP_INTEGER:
+                field_value = PyLong_FromLongLong(tmp->value.i);
+                break;
+            case LP_UINTEGER:
+                field_value = PyLong_FromUnsignedLongLong(tmp->value.i);
+                break;
+            case LP_BOOLEAN:
+                field_value = PyBool_FromLong(tmp->value.b);
+                break;
+            case LP_STRING:
+                field_value = PyUnicode_FromString(tmp->value.s);
+                break;
+            default:
+                PyErr_SetString(LineFormatError, "Unexpected value type.");
                 goto except;
-            }
-            Py_DECREF(field_value);
-            tmp = tmp->next_item;
         }
+        if (field_value == NULL) {
+            goto except;
+        }
+        if ((PyDict_SetItemString(fields, tmp->key, field_value)) == -1) {
+            goto except;
+        }
+        Py_DECREF(field_value);
+        field_value = NULL;
+        tmp = tmp->next_item;
     }
     if ((time = PyLong_FromUnsignedLongLong(point->time)) == NULL){
         goto except;
@@ -164,6 +198,74 @@ finally:
     Py_XDECREF(tags);
     Py_XDECREF(fields);
     Py_XDECREF(time);
+    return output;
+}
+
+/* Convert a linked list of points to a list of dictionaries */
+static PyObject*
+points_to_list(const struct LP_Point *point)
+{
+    PyObject *output = NULL;
+    PyObject *item = NULL;
+    if ((output = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+    for (; point != NULL; point = point->next_point) {
+        if ((item = point_to_dict(point)) == NULL) {
+            Py_DECREF(output);
+            return NULL;
+        }
+        if (PyList_Append(output, item) == -1) {
+            Py_DECREF(item);
+            Py_DECREF(output);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return output;
+}
+
+PyDoc_STRVAR(parse_line__doc__,
+"Parse a line protocol string into a dictionary.\n\
+\n\
+Returns a dictionary with keys 'measurement', 'fields', 'tags' and\n\
+'time'. Rases `LineFormatError` when input can't be parsed.\n\
+");
+
+static PyObject*
+parse_line(PyObject* self, PyObject* args)
+{
+    PyObject *input = NULL, *output = NULL;
+    struct LP_Point *point = NULL;
+    char *line = NULL;
+    int status = 0;
+    goto try;
+try:
+    assert(!PyErr_Occurred());
+    assert(args);
+    if (PyBytes_Check(args)) {
+        input = args;
+        Py_INCREF(input);
+    } else if ((input = PyUnicode_AsEncodedString(args, NULL, NULL)) == NULL) {
+        return NULL;
+    }
+    if ((line = PyBytes_AsString(input)) == NULL) {
+        goto except;
+    }
+    point = LP_parse_line(line, &status);
+    // Check status and raise exception based on status
+    if (point == NULL) {
+        set_parse_error(status);
+        goto except;
+    }
+    if ((output = point_to_dict(point)) == NULL) {
+        goto except;
+    }
+    assert(!PyErr_Occurred());
+    goto finally;
+except:
+    output = NULL;
+finally:
     Py_XDECREF(input);
     if (point != NULL){
         LP_free_point(point);
@@ -171,30 +273,1743 @@ finally:
     return output;
 }
 
-static PyMethodDef _line_protocol_functions[] = {
-    {"parse_line", (PyCFunction)parse_line, METH_O, parse_line__doc__},
+PyDoc_STRVAR(Aggregator__doc__,
+"Aggregator(interval, lateness=0, max_rows=100000)\n\
+\n\
+Downsample line protocol into per-series time buckets.\n\
+\n\
+Points are grouped by measurement, tags and the bucket\n\
+`time - time % interval` (nanoseconds). For every float, integer and\n\
+unsigned integer field the rows hold 'count_<key>', 'min_<key>',\n\
+'max_<key>', 'sum_<key>' and 'last_<key>'. Boolean and string fields\n\
+are ignored, points without numeric fields are skipped. A field whose\n\
+type differs from its first value in the bucket is dropped and counted\n\
+in `conflicts`.\n\
+\n\
+A bucket is closed once a point more than `lateness` nanoseconds past\n\
+its end has been seen. Points arriving for a closed bucket are dropped\n\
+and counted in `late`. At most `max_rows` rows are kept open, when full\n\
+the oldest row is emitted early and counted in `evicted`.\n\
+");
+
+typedef struct {
+    PyObject_HEAD
+    struct LP_Aggregator *agg;
+} AggregatorObject;
+
+static int
+Aggregator_init(AggregatorObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"interval", "lateness", "max_rows", NULL};
+    unsigned long long interval = 0;
+    unsigned long long lateness = 0;
+    Py_ssize_t max_rows = 100000;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "K|Kn", kwlist,
+                                     &interval, &lateness, &max_rows)) {
+        return -1;
+    }
+    if (interval == 0) {
+        PyErr_SetString(PyExc_ValueError, "interval must be positive.");
+        return -1;
+    }
+    if (max_rows <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_rows must be positive.");
+        return -1;
+    }
+    LP_free_aggregator(self->agg);
+    self->agg = LP_new_aggregator(interval, lateness, (size_t)max_rows);
+    if (self->agg == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+static void
+Aggregator_dealloc(AggregatorObject *self)
+{
+    LP_free_aggregator(self->agg);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/* Collect the closed rows as a list of dictionaries */
+static PyObject*
+Aggregator_collect(AggregatorObject *self, int flush)
+{
+    PyObject *output = NULL;
+    struct LP_Point *rows = LP_aggregator_closed(self->agg, flush);
+    output = points_to_list(rows);
+    LP_free_point(rows);
+    return output;
+}
+
+PyDoc_STRVAR(Aggregator_feed__doc__,
+"feed(data) -> list\n\
+\n\
+Aggregate newline-separated line protocol (str or bytes). Returns the\n\
+rows of all buckets closed so far. Raises `LineFormatError` if a line\n\
+can't be parsed, the lines before it are still aggregated.\n\
+");
+
+static PyObject*
+Aggregator_feed(AggregatorObject *self, PyObject *arg)
+{
+    PyObject *input = NULL;
+    const char *data = NULL;
+    Py_ssize_t length = 0;
+    size_t offset = 0, next = 0, line_length = 0, lineno = 0;
+    struct LP_Point *point = NULL;
+    int status = 0;
+
+    if (self->agg == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Aggregator is not initialized.");
+        return NULL;
+    }
+    if ((input = get_bytes(arg, &data, &length)) == NULL) {
+        return NULL;
+    }
+    while (offset < (size_t)length) {
+        line_length = LP_next_line(data + offset, length - offset, &next);
+        lineno++;
+        if (!LP_is_blank_line(data + offset, line_length)) {
+            if ((point = LP_parse_line_n(data + offset, line_length, &status)) == NULL) {
+                set_parse_error_at(status, "line", lineno);
+                Py_DECREF(input);
+                return NULL;
+            }
+            if (LP_aggregate_point(self->agg, point) == 0) {
+                LP_free_point(point);
+                Py_DECREF(input);
+                return PyErr_NoMemory();
+            }
+            LP_free_point(point);
+        }
+        offset += next;
+    }
+    Py_DECREF(input);
+    return Aggregator_collect(self, 0);
+}
+
+PyDoc_STRVAR(Aggregator_flush__doc__,
+"flush() -> list\n\
+\n\
+Close all open buckets and return their rows.\n\
+");
+
+static PyObject*
+Aggregator_flush(AggregatorObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (self->agg == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Aggregator is not initialized.");
+        return NULL;
+    }
+    return Aggregator_collect(self, 1);
+}
+
+static PyObject*
+Aggregator_get_counter(AggregatorObject *self, void *closure)
+{
+    unsigned long long late = 0, evicted = 0, conflicts = 0;
+    const char *name = closure;
+    if (self->agg != NULL) {
+        LP_aggregator_counters(self->agg, &late, &evicted, &conflicts);
+    }
+    if (strcmp(name, "late") == 0) {
+        return PyLong_FromUnsignedLongLong(late);
+    }
+    if (strcmp(name, "evicted") == 0) {
+        return PyLong_FromUnsignedLongLong(evicted);
+    }
+    return PyLong_FromUnsignedLongLong(conflicts);
+}
+
+static PyMethodDef Aggregator_methods[] = {
+    {"feed", (PyCFunction)Aggregator_feed, METH_O, Aggregator_feed__doc__},
+    {"flush", (PyCFunction)Aggregator_flush, METH_NOARGS, Aggregator_flush__doc__},
     {NULL, NULL, 0, NULL}
 };
 
-static struct PyModuleDef _line_protocol_parser_module = {
-	PyModuleDef_HEAD_INIT,
-	"_line_protocol_parser",
-	module_doc,
-	-1,
-	_line_protocol_functions
+static PyGetSetDef Aggregator_getset[] = {
+    {"late", (getter)Aggregator_get_counter, NULL,
+     "Number of points dropped because their bucket was closed.", "late"},
+    {"evicted", (getter)Aggregator_get_counter, NULL,
+     "Number of rows emitted early to stay within max_rows.", "evicted"},
+    {"conflicts", (getter)Aggregator_get_counter, NULL,
+     "Number of field values dropped because of a type conflict.", "conflicts"},
+    {NULL}
 };
 
-PyMODINIT_FUNC
-PyInit__line_protocol_parser(void){
-    PyObject* module = PyModule_Create(&_line_protocol_parser_module);
-    if (module == NULL) {
+static PyTypeObject AggregatorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_line_protocol_parser.Aggregator",
+    .tp_doc = Aggregator__doc__,
+    .tp_basicsize = sizeof(AggregatorObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Aggregator_init,
+    .tp_dealloc = (destructor)Aggregator_dealloc,
+    .tp_methods = Aggregator_methods,
+    .tp_getset = Aggregator_getset,
+};
+
+PyDoc_STRVAR(Reader__doc__,
+"Reader(source, encoding=None, buffer_size=65536)\n\
+\n\
+Iterate over the points of a line protocol stream.\n\
+\n\
+`source` is a binary file-like object with a `read(size)` method, e.g.\n\
+an HTTP request body. `encoding` is the content encoding of the stream:\n\
+None or 'identity', 'gzip', 'deflate' or 'zstd' (Python 3.14+).\n\
+Compressed input is decompressed `buffer_size` bytes at a time into a\n\
+fixed buffer which is parsed before more input is read, so the whole\n\
+decompressed body is never held in memory. The buffer only grows if a\n\
+single line is longer than `buffer_size`.\n\
+\n\
+Each iteration returns a dictionary like `parse_line`. Raises\n\
+`LineFormatError` for lines that can't be parsed and `EOFError` if a\n\
+compressed stream is truncated.\n\
+");
+
+enum _LP_Encoding {
+    LP_IDENTITY,
+    LP_ZLIB,
+    LP_ZSTD
+};
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *source;
+    PyObject *decompressor;
+    /* Compressed input not yet consumed by the decompressor */
+    PyObject *pending;
+    enum _LP_Encoding encoding;
+    int wbits;
+    Py_ssize_t chunk_size;
+    int input_seen;
+    int starved;
+    int source_done;
+    int done;
+    size_t lineno;
+    struct LP_LineBuffer buffer;
+} ReaderObject;
+
+static PyObject*
+new_decompressor(ReaderObject *self)
+{
+    PyObject *module = NULL;
+    PyObject *output = NULL;
+    if (self->encoding == LP_ZLIB) {
+        if ((module = PyImport_ImportModule("zlib")) == NULL) {
+            return NULL;
+        }
+        output = PyObject_CallMethod(module, "decompressobj", "i", self->wbits);
+    } else {
+        if ((module = PyImport_ImportModule("compression.zstd")) == NULL) {
+            return NULL;
+        }
+        output = PyObject_CallMethod(module, "ZstdDecompressor", NULL);
+    }
+    Py_DECREF(module);
+    return output;
+}
+
+/* Read the next chunk from the source, at most `size` bytes */
+static PyObject*
+Reader_read_source(ReaderObject *self, Py_ssize_t size)
+{
+    PyObject *chunk = PyObject_CallMethod(self->source, "read", "n", size);
+    if (chunk == NULL) {
         return NULL;
     }
-    LineFormatError = PyErr_NewExceptionWithDoc(
-        "_line_protocol_parser.LineFormatError", LineFormatError__doc__, NULL, NULL);
-    Py_XINCREF(LineFormatError);
-    if (PyModule_AddObject(module, "LineFormatError", LineFormatError) < 0){
-        Py_XDECREF(LineFormatError);
+    if (!PyBytes_Check(chunk)) {
+        PyErr_Format(PyExc_TypeError, "read() should return bytes, not %.200s",
+                     Py_TYPE(chunk)->tp_name);
+        Py_DECREF(chunk);
+        return NULL;
+    }
+    if (PyBytes_GET_SIZE(chunk) > size) {
+        PyErr_Format(PyExc_ValueError, "read() returned too much data: "
+                     "%zd bytes requested, %zd returned", size,
+                     PyBytes_GET_SIZE(chunk));
+        Py_DECREF(chunk);
+        return NULL;
+    }
+    if (PyBytes_GET_SIZE(chunk) == 0) {
+        self->source_done = 1;
+    }
+    return chunk;
+}
+
+/* Set `eof` to the end-of-stream flag of the decompressor. When a stream
+ * has ended but more data follows (e.g. gzip members), a new decompressor
+ * takes over. */
+static int
+Reader_check_eof(ReaderObject *self, int *eof)
+{
+    PyObject *flag = NULL;
+    PyObject *unused = NULL;
+    PyObject *decompressor = NULL;
+    if ((flag = PyObject_GetAttrString(self->decompressor, "eof")) == NULL) {
+        return -1;
+    }
+    *eof = PyObject_IsTrue(flag);
+    Py_DECREF(flag);
+    if (*eof != 1) {
+        return *eof;
+    }
+    if ((unused = PyObject_GetAttrString(self->decompressor, "unused_data")) == NULL) {
+        return -1;
+    }
+    if (PyBytes_GET_SIZE(unused) == 0) {
+        Py_DECREF(unused);
+        return 0;
+    }
+    if ((decompressor = new_decompressor(self)) == NULL) {
+        Py_DECREF(unused);
+        return -1;
+    }
+    Py_SETREF(self->decompressor, decompressor);
+    Py_XSETREF(self->pending, unused);
+    self->starved = 0;
+    *eof = 0;
+    return 0;
+}
+
+/* Produce at most `space` bytes of decompressed data. An empty result with
+ * `end` set means the stream is finished. */
+static PyObject*
+Reader_decompress(ReaderObject *self, Py_ssize_t space, int *end)
+{
+    PyObject *output = NULL;
+    PyObject *tail = NULL;
+    PyObject *flag = NULL;
+    PyObject *decompressor = NULL;
+    int eof = 0;
+    int needs_input = 1;
+
+    *end = 0;
+    if (self->encoding == LP_ZSTD && self->pending == NULL) {
+        if ((flag = PyObject_GetAttrString(self->decompressor, "eof")) == NULL) {
+            return NULL;
+        }
+        eof = PyObject_IsTrue(flag);
+        Py_DECREF(flag);
+        if (eof == 0) {
+            if ((flag = PyObject_GetAttrString(self->decompressor, "needs_input")) == NULL) {
+                return NULL;
+            }
+            needs_input = PyObject_IsTrue(flag);
+            Py_DECREF(flag);
+        }
+        if (eof < 0 || needs_input < 0) {
+            return NULL;
+        }
+        self->starved = eof || needs_input;
+    }
+    if (self->starved && (self->pending == NULL || PyBytes_GET_SIZE(self->pending) == 0)) {
+        if (self->source_done) {
+            if (Reader_check_eof(self, &eof) < 0) {
+                return NULL;
+            }
+            if (self->input_seen && !eof && self->starved) {
+                PyErr_SetString(PyExc_EOFError, "Compressed stream ended before "
+                                "the end-of-stream marker was reached");
+                return NULL;
+            }
+            if (self->starved) {
+                *end = 1;
+                return PyBytes_FromStringAndSize(NULL, 0);
+            }
+        } else {
+            Py_XSETREF(self->pending, Reader_read_source(self, self->chunk_size));
+            if (self->pending == NULL) {
+                return NULL;
+            }
+            if (PyBytes_GET_SIZE(self->pending) == 0) {
+                return PyBytes_FromStringAndSize(NULL, 0);
+            }
+            self->input_seen = 1;
+            self->starved = 0;
+            if (eof) {
+                /* More data after a finished zstd frame */
+                if ((decompressor = new_decompressor(self)) == NULL) {
+                    return NULL;
+                }
+                Py_SETREF(self->decompressor, decompressor);
+            }
+        }
+    }
+    if (self->pending == NULL) {
+        output = PyObject_CallMethod(self->decompressor, "decompress", "yn", "", space);
+    } else {
+        output = PyObject_CallMethod(self->decompressor, "decompress", "On",
+                                     self->pending, space);
+    }
+    if (output == NULL) {
+        return NULL;
+    }
+    if (self->encoding == LP_ZLIB) {
+        if ((tail = PyObject_GetAttrString(self->decompressor, "unconsumed_tail")) == NULL) {
+            Py_DECREF(output);
+            return NULL;
+        }
+        Py_SETREF(self->pending, tail);
+    } else {
+        /* The zstd decompressor keeps unconsumed input itself */
+        Py_CLEAR(self->pending);
+    }
+    if (Reader_check_eof(self, &eof) < 0) {
+        Py_DECREF(output);
+        return NULL;
+    }
+    if (PyBytes_GET_SIZE(output) == 0
+        && (self->pending == NULL || PyBytes_GET_SIZE(self->pending) == 0)) {
+        self->starved = 1;
+    }
+    return output;
+}
+
+/* Write more input to the line buffer. Returns 1 when data was added,
+ * 0 at end of stream and -1 on error. */
+static int
+Reader_fill(ReaderObject *self)
+{
+    PyObject *chunk = NULL;
+    char *space_ptr = NULL;
+    size_t space = 0;
+    Py_ssize_t length = 0;
+    int end = 0;
+    do {
+        if ((space_ptr = LP_line_buffer_space(&self->buffer, &space)) == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (space > PY_SSIZE_T_MAX) {
+            space = PY_SSIZE_T_MAX;
+        }
+        if (self->encoding == LP_IDENTITY) {
+            chunk = Reader_read_source(self, (Py_ssize_t)space);
+            end = self->source_done;
+        } else {
+            chunk = Reader_decompress(self, (Py_ssize_t)space, &end);
+        }
+        if (chunk == NULL) {
+            return -1;
+        }
+        length = PyBytes_GET_SIZE(chunk);
+        if ((size_t)length > space) {
+            PyErr_SetString(PyExc_ValueError, "Decompressor returned too much data.");
+            Py_DECREF(chunk);
+            return -1;
+        }
+        memcpy(space_ptr, PyBytes_AS_STRING(chunk), length);
+        LP_line_buffer_commit(&self->buffer, length);
+        Py_DECREF(chunk);
+    } while (length == 0 && !end);
+    return length > 0;
+}
+
+static int
+Reader_init(ReaderObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"source", "encoding", "buffer_size", NULL};
+    PyObject *source = NULL;
+    const char *encoding = NULL;
+    Py_ssize_t buffer_size = 65536;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|zn", kwlist,
+                                     &source, &encoding, &buffer_size)) {
+        return -1;
+    }
+    if (buffer_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "buffer_size must be positive.");
+        return -1;
+    }
+    if (encoding == NULL || strcmp(encoding, "identity") == 0) {
+        self->encoding = LP_IDENTITY;
+    } else if (strcmp(encoding, "gzip") == 0) {
+        self->encoding = LP_ZLIB;
+        self->wbits = 16 + 15;
+    } else if (strcmp(encoding, "deflate") == 0) {
+        self->encoding = LP_ZLIB;
+        self->wbits = 15;
+    } else if (strcmp(encoding, "zstd") == 0) {
+        self->encoding = LP_ZSTD;
+    } else {
+        PyErr_Format(PyExc_ValueError, "Unsupported encoding: '%s'.", encoding);
+        return -1;
+    }
+    Py_CLEAR(self->decompressor);
+    Py_CLEAR(self->pending);
+    if (self->encoding != LP_IDENTITY
+        && (self->decompressor = new_decompressor(self)) == NULL) {
+        return -1;
+    }
+    Py_INCREF(source);
+    Py_XSETREF(self->source, source);
+    LP_free_line_buffer(&self->buffer);
+    if (!LP_init_line_buffer(&self->buffer, (size_t)buffer_size)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->chunk_size = buffer_size;
+    self->input_seen = 0;
+    self->starved = 1;
+    self->source_done = 0;
+    self->done = 0;
+    self->lineno = 0;
+    return 0;
+}
+
+static int
+Reader_traverse(ReaderObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->source);
+    Py_VISIT(self->decompressor);
+    return 0;
+}
+
+static int
+Reader_clear(ReaderObject *self)
+{
+    Py_CLEAR(self->source);
+    Py_CLEAR(self->decompressor);
+    Py_CLEAR(self->pending);
+    return 0;
+}
+
+static void
+Reader_dealloc(ReaderObject *self)
+{
+    PyObject_GC_UnTrack(self);
+    Reader_clear(self);
+    LP_free_line_buffer(&self->buffer);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject*
+Reader_iternext(ReaderObject *self)
+{
+    const char *line = NULL;
+    size_t length = 0;
+    struct LP_Point *point = NULL;
+    PyObject *output = NULL;
+    int status = 0;
+    int filled = 0;
+
+    if (self->source == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Reader is not initialized.");
+        return NULL;
+    }
+    for (;;) {
+        while (LP_line_buffer_next(&self->buffer, self->done, &line, &length)) {
+            self->lineno++;
+            if (LP_is_blank_line(line, length)) {
+                continue;
+            }
+            if ((point = LP_parse_line_n(line, length, &status)) == NULL) {
+                set_parse_error_at(status, "line", self->lineno);
+                return NULL;
+            }
+            output = point_to_dict(point);
+            LP_free_point(point);
+            return output;
+        }
+        if (self->done) {
+            return NULL;
+        }
+        if ((filled = Reader_fill(self)) < 0) {
+            return NULL;
+        }
+        if (filled == 0) {
+            self->done = 1;
+        }
+    }
+}
+
+static PyTypeObject ReaderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_line_protocol_parser.Reader",
+    .tp_doc = Reader__doc__,
+    .tp_basicsize = sizeof(ReaderObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Reader_init,
+    .tp_dealloc = (destructor)Reader_dealloc,
+    .tp_traverse = (traverseproc)Reader_traverse,
+    .tp_clear = (inquiry)Reader_clear,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)Reader_iternext,
+};
+
+#ifndef _WIN32
+
+PyDoc_STRVAR(Listener__doc__,
+"Listener(sock=None, max_batch=64, datagram_size=65536, max_queue=1024,\n\
+         block=False)\n\
+\n\
+Receive and parse line protocol on a background thread.\n\
+\n\
+`sock` is a bound UDP socket or a connected TCP socket. Up to\n\
+`max_batch` (at most 1024) datagrams of at most `datagram_size` bytes\n\
+are received per system call (recvmmsg on Linux) and parsed without\n\
+holding the GIL.\n\
+TCP streams are split into lines, `datagram_size` is then the initial\n\
+line buffer size. Lines longer than 1 MiB (or `datagram_size` if\n\
+larger) are skipped and counted as errors. Without `sock`, data is only added with `feed`, e.g.\n\
+HTTP request bodies.\n\
+\n\
+Each receive call or `feed` gives one batch of points, at most\n\
+`max_queue` batches are queued. When the queue is full new batches are\n\
+dropped, or with `block=True` the receiver waits (and the kernel drops\n\
+UDP packets instead). Lines that fail to parse are skipped. See\n\
+`stats` for the counters. Not available on Windows.\n\
+");
+
+typedef struct {
+    PyObject_HEAD
+    struct LP_Listener *listener;
+    PyObject *sock;
+} ListenerObject;
+
+static int
+Listener_init(ListenerObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"sock", "max_batch", "datagram_size", "max_queue",
+                             "block", NULL};
+    PyObject *sock = Py_None;
+    Py_ssize_t max_batch = 64, datagram_size = 65536, max_queue = 1024;
+    int block = 0;
+    int fd = -1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Onnnp", kwlist, &sock,
+                                     &max_batch, &datagram_size, &max_queue,
+                                     &block)) {
+        return -1;
+    }
+    if (max_batch <= 0 || datagram_size <= 0 || max_queue <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "max_batch, datagram_size and max_queue must be positive.");
+        return -1;
+    }
+    if (max_batch > LP_LISTENER_MAX_BATCH) {
+        PyErr_Format(PyExc_ValueError, "max_batch must be at most %d.",
+                     LP_LISTENER_MAX_BATCH);
+        return -1;
+    }
+    if (sock != Py_None && (fd = PyObject_AsFileDescriptor(sock)) < 0) {
+        return -1;
+    }
+    if (self->listener != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        LP_free_listener(self->listener);
+        Py_END_ALLOW_THREADS
+        self->listener = NULL;
+    }
+    self->listener = LP_new_listener(fd, (size_t)max_batch, (size_t)datagram_size,
+                                     (size_t)max_queue, block);
+    if (self->listener == NULL) {
+        if (errno == EINVAL) {
+            /* Buffer sizes would overflow */
+            PyErr_SetString(PyExc_ValueError,
+                            "datagram_size or max_queue is too large.");
+        } else {
+            PyErr_SetFromErrno(PyExc_OSError);
+        }
+        return -1;
+    }
+    /* Keep the socket (and its file descriptor) alive */
+    Py_INCREF(sock);
+    Py_XSETREF(self->sock, sock);
+    return 0;
+}
+
+static void
+Listener_dealloc(ListenerObject *self)
+{
+    if (self->listener != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        LP_free_listener(self->listener);
+        Py_END_ALLOW_THREADS
+    }
+    Py_XDECREF(self->sock);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+Listener_check(ListenerObject *self)
+{
+    if (self->listener == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Listener is not initialized.");
+        return -1;
+    }
+    return 0;
+}
+
+/* Wait for the next batch, `timeout` in seconds or forever if negative.
+ * Sets `status` like LP_listener_get, raises OSError if the receiver
+ * failed. Signals are checked while waiting. */
+static PyObject*
+Listener_next_batch(ListenerObject *self, double timeout, int *status)
+{
+    struct LP_Point *points = NULL;
+    PyObject *output = NULL;
+    long slice = 0;
+    double remaining = timeout;
+    int last = 0;
+    for (;;) {
+        last = (remaining >= 0 && remaining <= 0.1);
+        slice = last ? (long)(remaining * 1000) : 100;
+        Py_BEGIN_ALLOW_THREADS
+        points = LP_listener_get(self->listener, slice, status);
+        Py_END_ALLOW_THREADS
+        if (points != NULL) {
+            break;
+        }
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+        if (*status != LP_LISTENER_TIMEOUT || last) {
+            break;
+        }
+        if (remaining >= 0) {
+            remaining -= 0.1;
+        }
+    }
+    if (points == NULL) {
+        if (*status == LP_LISTENER_ERROR) {
+            errno = LP_listener_error(self->listener);
+            PyErr_SetFromErrno(PyExc_OSError);
+        }
+        return NULL;
+    }
+    output = points_to_list(points);
+    LP_free_point(points);
+    return output;
+}
+
+PyDoc_STRVAR(Listener_get__doc__,
+"get(timeout=None) -> list\n\
+\n\
+Return the next batch as a list of dictionaries. Waits at most\n\
+`timeout` seconds and returns None if nothing arrived. Once the queue\n\
+is empty, raises `OSError` if receiving failed (e.g. the TCP connection\n\
+was reset), or `EOFError` if the listener is closed (or the TCP peer\n\
+has closed the connection).\n\
+");
+
+static PyObject*
+Listener_get(ListenerObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"timeout", NULL};
+    PyObject *timeout_obj = Py_None;
+    PyObject *output = NULL;
+    double timeout = -1;
+    int status = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout_obj)) {
+        return NULL;
+    }
+    if (Listener_check(self) < 0) {
+        return NULL;
+    }
+    if (timeout_obj != Py_None) {
+        if ((timeout = PyFloat_AsDouble(timeout_obj)) == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative.");
+            return NULL;
+        }
+    }
+    output = Listener_next_batch(self, timeout, &status);
+    if (output != NULL || PyErr_Occurred()) {
+        return output;
+    }
+    if (status == LP_LISTENER_CLOSED) {
+        PyErr_SetString(PyExc_EOFError, "Listener is closed.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Listener_iternext(ListenerObject *self)
+{
+    int status = 0;
+    if (Listener_check(self) < 0) {
+        return NULL;
+    }
+    /* Returns NULL without exception (StopIteration) when closed */
+    return Listener_next_batch(self, -1, &status);
+}
+
+PyDoc_STRVAR(Listener_feed__doc__,
+"feed(data)\n\
+\n\
+Parse newline-separated line protocol (str or bytes) without the GIL\n\
+and queue it as one batch. With `block=True` a full queue makes it wait\n\
+until another thread calls `get`, or the listener is closed.\n\
+");
+
+static PyObject*
+Listener_feed(ListenerObject *self, PyObject *arg)
+{
+    PyObject *input = NULL;
+    const char *data = NULL;
+    Py_ssize_t length = 0;
+    int status = 0;
+    if (Listener_check(self) < 0) {
+        return NULL;
+    }
+    if ((input = get_bytes(arg, &data, &length)) == NULL) {
+        return NULL;
+    }
+    /* Wait for room in slices, checking signals in between */
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+        LP_listener_feed(self->listener, data, (size_t)length, 100, &status);
+        Py_END_ALLOW_THREADS
+        if (status != LP_LISTENER_TIMEOUT) {
+            break;
+        }
+        if (PyErr_CheckSignals() < 0) {
+            Py_DECREF(input);
+            return NULL;
+        }
+    }
+    Py_DECREF(input);
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(Listener_close__doc__,
+"close()\n\
+\n\
+Stop receiving. Queued batches can still be taken with `get`.\n\
+The socket is not closed.\n\
+");
+
+static PyObject*
+Listener_close(ListenerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (Listener_check(self) < 0) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    LP_close_listener(self->listener);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Listener_get_stats(ListenerObject *self, void *closure)
+{
+    struct LP_ListenerStats stats;
+    if (Listener_check(self) < 0) {
+        return NULL;
+    }
+    LP_listener_stats(self->listener, &stats);
+    return Py_BuildValue("{sKsKsKsKsKsKsK}",
+                         "reads", stats.reads, "bytes", stats.bytes,
+                         "points", stats.points, "errors", stats.errors,
+                         "dropped", stats.dropped, "blocked", stats.blocked,
+                         "queued", stats.queued);
+}
+
+static PyMethodDef Listener_methods[] = {
+    {"get", (PyCFunction)(void(*)(void))Listener_get, METH_VARARGS | METH_KEYWORDS,
+     Listener_get__doc__},
+    {"feed", (PyCFunction)Listener_feed, METH_O, Listener_feed__doc__},
+    {"close", (PyCFunction)Listener_close, METH_NOARGS, Listener_close__doc__},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef Listener_getset[] = {
+    {"stats", (getter)Listener_get_stats, NULL,
+     "Counters: reads, bytes, points, errors, dropped, blocked and queued.", NULL},
+    {NULL}
+};
+
+static PyTypeObject ListenerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_line_protocol_parser.Listener",
+    .tp_doc = Listener__doc__,
+    .tp_basicsize = sizeof(ListenerObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Listener_init,
+    .tp_dealloc = (destructor)Listener_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)Listener_iternext,
+    .tp_methods = Listener_methods,
+    .tp_getset = Listener_getset,
+};
+
+#endif
+
+/* Size of the chunks read when scanning or parsing files */
+#define LP_FILE_CHUNK_SIZE (1 << 20)
+
+/* Return `path` with the index file suffix appended */
+static PyObject*
+index_path(PyObject *path)
+{
+    PyObject *fspath = NULL;
+    PyObject *output = NULL;
+    if ((fspath = PyOS_FSPath(path)) == NULL) {
+        return NULL;
+    }
+    if (PyBytes_Check(fspath)) {
+        output = PyBytes_FromFormat("%s.lpidx", PyBytes_AS_STRING(fspath));
+    } else {
+        output = PyUnicode_FromFormat("%U.lpidx", fspath);
+    }
+    Py_DECREF(fspath);
+    return output;
+}
+
+/* Size and modification time (ns) of the file, used to detect stale
+ * indexes */
+static int
+stat_file(PyObject *path, unsigned long long *size, unsigned long long *mtime)
+{
+    PyObject *os = NULL, *st = NULL, *value = NULL;
+    int output = -1;
+    if ((os = PyImport_ImportModule("os")) == NULL) {
+        return -1;
+    }
+    if ((st = PyObject_CallMethod(os, "stat", "O", path)) == NULL) {
+        goto finally;
+    }
+    if ((value = PyObject_GetAttrString(st, "st_size")) == NULL) {
+        goto finally;
+    }
+    *size = PyLong_AsUnsignedLongLong(value);
+    Py_DECREF(value);
+    if ((value = PyObject_GetAttrString(st, "st_mtime_ns")) == NULL) {
+        goto finally;
+    }
+    *mtime = PyLong_AsUnsignedLongLong(value);
+    Py_DECREF(value);
+    if (!PyErr_Occurred()) {
+        output = 0;
+    }
+finally:
+    Py_XDECREF(st);
+    Py_DECREF(os);
+    return output;
+}
+
+static PyObject*
+open_file(PyObject *path, const char *mode)
+{
+    PyObject *io = NULL;
+    PyObject *output = NULL;
+    if ((io = PyImport_ImportModule("io")) == NULL) {
+        return NULL;
+    }
+    output = PyObject_CallMethod(io, "open", "Os", path, mode);
+    Py_DECREF(io);
+    return output;
+}
+
+/* Close the file without clobbering a pending exception */
+static int
+close_file(PyObject *file)
+{
+    PyObject *type = NULL, *value = NULL, *traceback = NULL;
+    PyObject *result = NULL;
+    int failed = PyErr_Occurred() != NULL;
+    if (file == NULL) {
+        return 0;
+    }
+    if (failed) {
+        PyErr_Fetch(&type, &value, &traceback);
+    }
+    result = PyObject_CallMethod(file, "close", NULL);
+    if (failed) {
+        Py_XDECREF(result);
+        PyErr_Restore(type, value, traceback);
+        return -1;
+    }
+    if (result == NULL) {
+        return -1;
+    }
+    Py_DECREF(result);
+    return 0;
+}
+
+/* Read at most `limit` bytes from the file into the free space of the
+ * line buffer. Returns the number of bytes read or -1 on error. */
+static Py_ssize_t
+read_into_buffer(PyObject *file, struct LP_LineBuffer *buffer, size_t limit)
+{
+    PyObject *view = NULL, *result = NULL;
+    char *space_ptr = NULL;
+    size_t space = 0;
+    Py_ssize_t length = 0;
+    if ((space_ptr = LP_line_buffer_space(buffer, &space)) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (space > limit) {
+        space = limit;
+    }
+    if (space > PY_SSIZE_T_MAX) {
+        space = PY_SSIZE_T_MAX;
+    }
+    if (space == 0) {
+        return 0;
+    }
+    view = PyMemoryView_FromMemory(space_ptr, (Py_ssize_t)space, PyBUF_WRITE);
+    if (view == NULL) {
+        return -1;
+    }
+    result = PyObject_CallMethod(file, "readinto", "O", view);
+    Py_DECREF(view);
+    if (result == NULL) {
+        return -1;
+    }
+    length = PyLong_AsSsize_t(result);
+    Py_DECREF(result);
+    if (length < 0 || (size_t)length > space) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError, "readinto() returned an invalid length.");
+        }
+        return -1;
+    }
+    LP_line_buffer_commit(buffer, length);
+    return length;
+}
+
+/* Load the index of `path` if it exists and matches the file. Returns 1
+ * when loaded, 0 when missing or stale and -1 on error. */
+static int
+load_index(PyObject *path, struct LP_TimeIndex *index)
+{
+    PyObject *idx_path = NULL, *file = NULL, *data = NULL;
+    unsigned long long size = 0, mtime = 0;
+    int output = -1;
+    if (stat_file(path, &size, &mtime) < 0) {
+        return -1;
+    }
+    if ((idx_path = index_path(path)) == NULL) {
+        return -1;
+    }
+    if ((file = open_file(idx_path, "rb")) == NULL) {
+        if (PyErr_ExceptionMatches(PyExc_FileNotFoundError)) {
+            PyErr_Clear();
+            output = 0;
+        }
+        goto finally;
+    }
+    if ((data = PyObject_CallMethod(file, "read", NULL)) == NULL) {
+        goto finally;
+    }
+    if (!PyBytes_Check(data)) {
+        PyErr_SetString(PyExc_TypeError, "read() should return bytes.");
+        goto finally;
+    }
+    output = LP_decode_time_index(index, PyBytes_AS_STRING(data),
+                                  PyBytes_GET_SIZE(data));
+    if (output < 0) {
+        PyErr_NoMemory();
+    } else if (output == 1 && (index->file_size != size || index->file_mtime != mtime)) {
+        output = 0;
+    }
+finally:
+    if (close_file(file) < 0) {
+        output = -1;
+    }
+    Py_XDECREF(data);
+    Py_XDECREF(idx_path);
+    return output;
+}
+
+PyDoc_STRVAR(build_index__doc__,
+"build_index(path, block_size=1048576) -> int\n\
+\n\
+Scan a line protocol file and write a sparse time index next to it\n\
+('<path>.lpidx'). The file is split into blocks of about `block_size`\n\
+bytes of whole lines and the offset and min/max time of every block is\n\
+stored. Only the timestamps are read, the lines are not validated.\n\
+Returns the number of blocks. Used by `parse_file`.\n\
+");
+
+static PyObject*
+build_index(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"path", "block_size", NULL};
+    PyObject *path = NULL, *file = NULL, *idx_path = NULL, *data = NULL;
+    PyObject *result = NULL, *output = NULL;
+    unsigned long long block_size = 1 << 20;
+    struct LP_TimeIndex index;
+    struct LP_LineBuffer buffer;
+    Py_ssize_t length = 0;
+    size_t consumed = 0;
+    int status = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|K", kwlist, &path, &block_size)) {
+        return NULL;
+    }
+    if (block_size == 0) {
+        PyErr_SetString(PyExc_ValueError, "block_size must be positive.");
+        return NULL;
+    }
+    LP_init_time_index(&index, block_size);
+    if (!LP_init_line_buffer(&buffer, LP_FILE_CHUNK_SIZE)) {
+        return PyErr_NoMemory();
+    }
+    if (stat_file(path, &index.file_size, &index.file_mtime) < 0) {
+        goto finally;
+    }
+    if ((file = open_file(path, "rb")) == NULL) {
+        goto finally;
+    }
+    do {
+        if ((length = read_into_buffer(file, &buffer, (size_t)-1)) < 0) {
+            goto finally;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        consumed = LP_time_index_scan(&index, buffer.data + buffer.start,
+                                      buffer.end - buffer.start, length == 0,
+                                      &status);
+        Py_END_ALLOW_THREADS
+        if (status != 0) {
+            PyErr_NoMemory();
+            goto finally;
+        }
+        buffer.start += consumed;
+    } while (length > 0);
+    if (close_file(file) < 0) {
+        file = NULL;
+        goto finally;
+    }
+    file = NULL;
+
+    data = PyBytes_FromStringAndSize(NULL, LP_time_index_encoded_size(&index));
+    if (data == NULL) {
+        goto finally;
+    }
+    LP_encode_time_index(&index, PyBytes_AS_STRING(data));
+    if ((idx_path = index_path(path)) == NULL) {
+        goto finally;
+    }
+    if ((file = open_file(idx_path, "wb")) == NULL) {
+        goto finally;
+    }
+    if ((result = PyObject_CallMethod(file, "write", "O", data)) == NULL) {
+        goto finally;
+    }
+    output = PyLong_FromSize_t(index.nr_blocks);
+finally:
+    if (close_file(file) < 0) {
+        Py_CLEAR(output);
+    }
+    Py_XDECREF(result);
+    Py_XDECREF(data);
+    Py_XDECREF(idx_path);
+    LP_free_line_buffer(&buffer);
+    LP_free_time_index(&index);
+    return output;
+}
+
+/* Parse the lines in `length` bytes at `offset` with a time in
+ * [start, end) and append them to `output` */
+static int
+parse_file_range(PyObject *file, unsigned long long offset, unsigned long long length,
+                 unsigned long long start, unsigned long long end, PyObject *output)
+{
+    PyObject *result = NULL, *item = NULL;
+    struct LP_LineBuffer buffer;
+    struct LP_Point *point = NULL;
+    unsigned long long time = 0;
+    unsigned long long position = offset;
+    unsigned long long line_offset = 0;
+    const char *line = NULL;
+    size_t line_length = 0;
+    size_t unread = 0;
+    Py_ssize_t nr_read = 0;
+    int status = 0;
+    int output_status = -1;
+
+    if ((result = PyObject_CallMethod(file, "seek", "K", offset)) == NULL) {
+        return -1;
+    }
+    Py_DECREF(result);
+    if (!LP_init_line_buffer(&buffer, LP_FILE_CHUNK_SIZE)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    do {
+        if ((nr_read = read_into_buffer(file, &buffer,
+                                        length < SIZE_MAX ? (size_t)length : SIZE_MAX)) < 0) {
+            goto finally;
+        }
+        length -= nr_read;
+        unread = buffer.end - buffer.start;
+        while (LP_line_buffer_next(&buffer, nr_read == 0 || length == 0,
+                                   &line, &line_length)) {
+            line_offset = position;
+            position += unread - (buffer.end - buffer.start);
+            unread = buffer.end - buffer.start;
+            if (LP_is_blank_line(line, line_length)) {
+                continue;
+            }
+            /* Check the time before doing the full parse */
+            LP_scan_time(line, line_length, &time);
+            if (time < start || time >= end) {
+                continue;
+            }
+            if ((point = LP_parse_line_n(line, line_length, &status)) == NULL) {
+                set_parse_error_at(status, "offset", line_offset);
+                goto finally;
+            }
+            if (point->time >= start && point->time < end) {
+                if ((item = point_to_dict(point)) == NULL) {
+                    LP_free_point(point);
+                    goto finally;
+                }
+                if (PyList_Append(output, item) == -1) {
+                    Py_DECREF(item);
+                    LP_free_point(point);
+                    goto finally;
+                }
+                Py_DECREF(item);
+            }
+            LP_free_point(point);
+        }
+    } while (nr_read > 0 && length > 0);
+    output_status = 0;
+finally:
+    LP_free_line_buffer(&buffer);
+    return output_status;
+}
+
+PyDoc_STRVAR(parse_file__doc__,
+"parse_file(path, start=None, end=None) -> list\n\
+\n\
+Parse the points of a line protocol file with `start <= time < end`.\n\
+If an up-to-date index made by `build_index` exists, only the blocks\n\
+overlapping the time range are read. Otherwise the whole file is\n\
+scanned. Lines outside the time range are not validated.\n\
+");
+
+static PyObject*
+parse_file(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"path", "start", "end", NULL};
+    PyObject *path = NULL, *start_obj = Py_None, *end_obj = Py_None;
+    PyObject *file = NULL, *output = NULL;
+    unsigned long long start = 0, end = ULLONG_MAX;
+    unsigned long long offset = 0, length = 0;
+    struct LP_TimeIndex index;
+    struct LP_TimeBlock *block = NULL;
+    size_t i;
+    int loaded = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
+                                     &path, &start_obj, &end_obj)) {
+        return NULL;
+    }
+    if (start_obj != Py_None) {
+        start = PyLong_AsUnsignedLongLong(start_obj);
+    }
+    if (end_obj != Py_None) {
+        end = PyLong_AsUnsignedLongLong(end_obj);
+    }
+    if (PyErr_Occurred()) {
+        return NULL;
+    }
+    LP_init_time_index(&index, 1);
+    if ((loaded = load_index(path, &index)) < 0) {
+        goto except;
+    }
+    if ((file = open_file(path, "rb")) == NULL) {
+        goto except;
+    }
+    if ((output = PyList_New(0)) == NULL) {
+        goto except;
+    }
+    if (!loaded) {
+        if (parse_file_range(file, 0, ULLONG_MAX, start, end, output) < 0) {
+            goto except;
+        }
+        goto finally;
+    }
+    /* Parse each run of adjacent blocks overlapping the range */
+    for (i = 0; i <= index.nr_blocks; i++) {
+        block = i < index.nr_blocks ? &index.blocks[i] : NULL;
+        if (block != NULL && block->min_time <= block->max_time
+            && block->max_time >= start && block->min_time < end) {
+            if (length == 0) {
+                offset = block->offset;
+            }
+            length += block->length;
+        } else if (length > 0) {
+            if (parse_file_range(file, offset, length, start, end, output) < 0) {
+                goto except;
+            }
+            length = 0;
+        }
+    }
+    goto finally;
+except:
+    Py_CLEAR(output);
+finally:
+    if (close_file(file) < 0) {
+        Py_CLEAR(output);
+    }
+    LP_free_time_index(&index);
+    return output;
+}
+
+/* Copy a str object to a NUL-terminated UTF-8 string allocated with
+ * LP_MALLOC */
+static char*
+copy_str(PyObject *obj, const char *what)
+{
+    const char *data = NULL;
+    Py_ssize_t length = 0;
+    char *output = NULL;
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "%s must be str, not %.200s", what,
+                     Py_TYPE(obj)->tp_name);
+        return NULL;
+    }
+    if ((data = PyUnicode_AsUTF8AndSize(obj, &length)) == NULL) {
+        return NULL;
+    }
+    if ((output = LP_MALLOC(length + 1)) == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memcpy(output, data, length + 1);
+    return output;
+}
+
+static struct LP_Item*
+new_dict_item(PyObject *key, struct LP_Item ***tail)
+{
+    struct LP_Item *item = LP_MALLOC(sizeof(*item));
+    if (item == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    item->type = LP_STRING;
+    item->value.s = NULL;
+    item->next_item = NULL;
+    **tail = item;
+    *tail = &item->next_item;
+    if ((item->key = copy_str(key, "key")) == NULL) {
+        return NULL;
+    }
+    return item;
+}
+
+/* Convert a dictionary like the ones returned by `parse_line` back to
+ * a point */
+static struct LP_Point*
+dict_to_point(PyObject *dict)
+{
+    struct LP_Point *point = NULL;
+    struct LP_Item *item = NULL, **tail = NULL;
+    PyObject *obj = NULL, *key = NULL, *value = NULL;
+    Py_ssize_t pos = 0;
+    int overflow = 0;
+
+    if (!PyDict_Check(dict)) {
+        PyErr_Format(PyExc_TypeError, "point must be dict, not %.200s",
+                     Py_TYPE(dict)->tp_name);
+        return NULL;
+    }
+    if ((point = LP_MALLOC(sizeof(*point))) == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memset(point, 0, sizeof(*point));
+    if ((obj = PyDict_GetItemString(dict, "measurement")) == NULL) {
+        PyErr_SetString(PyExc_KeyError, "measurement");
+        goto error;
+    }
+    if ((point->measurement = copy_str(obj, "measurement")) == NULL) {
+        goto error;
+    }
+    if ((obj = PyDict_GetItemString(dict, "time")) != NULL) {
+        point->time = PyLong_AsUnsignedLongLong(obj);
+        if (PyErr_Occurred()) {
+            goto error;
+        }
+    }
+    if ((obj = PyDict_GetItemString(dict, "tags")) != NULL) {
+        if (!PyDict_Check(obj)) {
+            PyErr_SetString(PyExc_TypeError, "tags must be dict");
+            goto error;
+        }
+        tail = &point->tags;
+        pos = 0;
+        while (PyDict_Next(obj, &pos, &key, &value)) {
+            if ((item = new_dict_item(key, &tail)) == NULL) {
+                goto error;
+            }
+            if ((item->value.s = copy_str(value, "tag value")) == NULL) {
+                goto error;
+            }
+        }
+    }
+    if ((obj = PyDict_GetItemString(dict, "fields")) == NULL || !PyDict_Check(obj)) {
+        PyErr_SetString(PyExc_TypeError, "fields must be dict");
+        goto error;
+    }
+    tail = &point->fields;
+    pos = 0;
+    while (PyDict_Next(obj, &pos, &key, &value)) {
+        if ((item = new_dict_item(key, &tail)) == NULL) {
+            goto error;
+        }
+        if (PyBool_Check(value)) {
+            item->type = LP_BOOLEAN;
+            item->value.b = (value == Py_True);
+        } else if (PyLong_Check(value)) {
+            item->type = LP_INTEGER;
+            item->value.i = PyLong_AsLongLongAndOverflow(value, &overflow);
+            if (overflow > 0) {
+                item->type = LP_UINTEGER;
+                item->value.i = (signed long long)PyLong_AsUnsignedLongLong(value);
+            }
+            if (PyErr_Occurred() || overflow < 0) {
+                item->type = LP_INTEGER;
+                PyErr_SetString(PyExc_OverflowError, "field value out of range");
+                goto error;
+            }
+        } else if (PyFloat_Check(value)) {
+            item->type = LP_FLOAT;
+            item->value.f = PyFloat_AS_DOUBLE(value);
+        } else if ((item->value.s = copy_str(value, "field value")) == NULL) {
+            goto error;
+        }
+    }
+    return point;
+error:
+    LP_free_point(point);
+    return NULL;
+}
+
+PyDoc_STRVAR(dump_batch__doc__,
+"dump_batch(data) -> bytes\n\
+\n\
+Encode points in a compact binary format which `load_batch` reads much\n\
+faster than the line protocol can be parsed. `data` is either line\n\
+protocol (str or bytes, one point per line) or a list of dictionaries\n\
+like the ones returned by `parse_line`.\n\
+");
+
+static PyObject*
+dump_batch(PyObject *self, PyObject *arg)
+{
+    PyObject *input = NULL, *iterator = NULL, *item = NULL, *output = NULL;
+    struct LP_Point *first = NULL, *point = NULL, **next_point = &first;
+    const char *data = NULL;
+    char *encoded = NULL;
+    Py_ssize_t length = 0;
+    size_t lineno = 0, encoded_length = 0;
+    int status = 0;
+
+    if (PyUnicode_Check(arg) || PyObject_CheckBuffer(arg)) {
+        if ((input = get_bytes(arg, &data, &length)) == NULL) {
+            return NULL;
+        }
+        first = LP_parse_lines(data, (size_t)length, &status, &lineno);
+        Py_DECREF(input);
+        if (first == NULL && status != LP_LINE_EMPTY) {
+            set_parse_error_at(status, "line", lineno);
+            return NULL;
+        }
+    } else {
+        if ((iterator = PyObject_GetIter(arg)) == NULL) {
+            return NULL;
+        }
+        while ((item = PyIter_Next(iterator)) != NULL) {
+            point = dict_to_point(item);
+            Py_DECREF(item);
+            if (point == NULL) {
+                goto finally;
+            }
+            *next_point = point;
+            next_point = &point->next_point;
+        }
+        if (PyErr_Occurred()) {
+            goto finally;
+        }
+    }
+    Py_BEGIN_ALLOW_THREADS
+    encoded = LP_dump_batch(first, &encoded_length);
+    Py_END_ALLOW_THREADS
+    if (encoded == NULL) {
+        PyErr_NoMemory();
+        goto finally;
+    }
+    output = PyBytes_FromStringAndSize(encoded, encoded_length);
+    LP_FREE(encoded);
+finally:
+    Py_XDECREF(iterator);
+    LP_free_point(first);
+    return output;
+}
+
+PyDoc_STRVAR(load_batch__doc__,
+"load_batch(data) -> list\n\
+\n\
+Decode a batch made by `dump_batch` into a list of dictionaries equal\n\
+to what `parse_line` returns for each line. `data` is any bytes-like\n\
+object, e.g. an mmap of a file, and is read in place. Every distinct\n\
+string is decoded once and shared between the points.\n\
+");
+
+static PyObject*
+load_batch(PyObject *self, PyObject *arg)
+{
+    Py_buffer buffer;
+    struct LP_BatchReader reader;
+    struct LP_BatchPoint record;
+    PyObject *strings = NULL, *series = NULL, *shapes = NULL, *output = NULL;
+    PyObject *point = NULL, *tags = NULL, *fields = NULL, *obj = NULL;
+    PyObject *template = NULL;
+    PyObject *measurement_key = NULL, *tags_key = NULL;
+    PyObject *fields_key = NULL, *time_key = NULL;
+    union LP_Value value;
+    const size_t *items = NULL;
+    const char *str = NULL;
+    size_t i, j, n = 0, measurement = 0, length = 0;
+    int result = 0, gc_enabled = 0;
+
+    if (PyObject_GetBuffer(arg, &buffer, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+    if ((result = LP_open_batch(&reader, buffer.buf, (size_t)buffer.len)) != 1) {
+        if (result < 0) {
+            PyErr_NoMemory();
+        } else {
+            PyErr_SetString(PyExc_ValueError, "Invalid batch data.");
+        }
+        goto except;
+    }
+    if ((strings = PyList_New(reader.nr_strings)) == NULL) {
+        goto except;
+    }
+    for (i = 0; i < reader.nr_strings; i++) {
+        str = LP_batch_string(&reader, i, &length);
+        if ((obj = PyUnicode_DecodeUTF8(str, length, NULL)) == NULL) {
+            goto except;
+        }
+        PyList_SET_ITEM(strings, i, obj);
+    }
+    /* The tags of every series, copied for each of its points */
+    if ((series = PyList_New(reader.nr_series)) == NULL) {
+        goto except;
+    }
+    for (i = 0; i < reader.nr_series; i++) {
+        n = LP_batch_series(&reader, i, &measurement, &items);
+        if ((obj = PyDict_New()) == NULL) {
+            goto except;
+        }
+        PyList_SET_ITEM(series, i, obj);
+        for (j = 0; j < n; j++) {
+            if (PyDict_SetItem(obj, PyList_GET_ITEM(strings, items[2 * j]),
+                               PyList_GET_ITEM(strings, items[2 * j + 1])) < 0) {
+                goto except;
+            }
+        }
+    }
+    /* And the field keys of every shape, copied and then filled in */
+    if ((shapes = PyList_New(reader.nr_shapes)) == NULL) {
+        goto except;
+    }
+    for (i = 0; i < reader.nr_shapes; i++) {
+        n = LP_batch_shape(&reader, i, &items);
+        if ((obj = PyDict_New()) == NULL) {
+            goto except;
+        }
+        PyList_SET_ITEM(shapes, i, obj);
+        for (j = 0; j < n; j++) {
+            if (PyDict_SetItem(obj, PyList_GET_ITEM(strings, items[2 * j]), Py_None) < 0) {
+                goto except;
+            }
+        }
+    }
+    measurement_key = PyUnicode_InternFromString("measurement");
+    tags_key = PyUnicode_InternFromString("tags");
+    fields_key = PyUnicode_InternFromString("fields");
+    time_key = PyUnicode_InternFromString("time");
+    if (!measurement_key || !tags_key || !fields_key || !time_key) {
+        goto except;
+    }
+    template = Py_BuildValue("{OOOOOOOO}", measurement_key, Py_None, tags_key, Py_None,
+                             fields_key, Py_None, time_key, Py_None);
+    if (template == NULL) {
+        goto except;
+    }
+    if ((output = PyList_New(reader.nr_points)) == NULL) {
+        goto except;
+    }
+#if PY_VERSION_HEX >= 0x030A0000
+    /* The points can't form reference cycles, don't let the collector
+     * scan the growing list over and over */
+    gc_enabled = PyGC_Disable();
+#endif
+    n = 0;
+    while ((result = LP_batch_next_point(&reader, &record)) == 1) {
+        if ((point = PyDict_Copy(template)) == NULL) {
+            goto except;
+        }
+        PyList_SET_ITEM(output, n++, point);
+        if ((tags = PyDict_Copy(PyList_GET_ITEM(series, record.series))) == NULL
+            || (fields = PyDict_Copy(PyList_GET_ITEM(shapes, record.shape))) == NULL) {
+            goto except;
+        }
+        if (PyDict_SetItem(point, measurement_key,
+                           PyList_GET_ITEM(strings, record.measurement)) < 0
+            || PyDict_SetItem(point, tags_key, tags) < 0
+            || PyDict_SetItem(point, fields_key, fields) < 0) {
+            goto except;
+        }
+        Py_CLEAR(tags);
+        for (j = 0; j < record.nr_fields; j++) {
+            if (!LP_batch_next_value(&reader, (enum LP_ValueType)record.fields[2 * j + 1],
+                                     &value)) {
+                result = -1;
+                break;
+            }
+            switch (record.fields[2 * j + 1]) {
+                case LP_FLOAT:
+                    obj = PyFloat_FromDouble(value.f);
+                    break;
+                case LP_INTEGER:
+                    obj = PyLong_FromLongLong(value.i);
+                    break;
+                case LP_UINTEGER:
+                    obj = PyLong_FromUnsignedLongLong(value.i);
+                    break;
+                case LP_BOOLEAN:
+                    obj = PyBool_FromLong(value.b);
+                    break;
+                default:
+                    obj = PyList_GET_ITEM(strings, (size_t)value.i);
+                    Py_INCREF(obj);
+                    break;
+            }
+            if (obj == NULL) {
+                goto except;
+            }
+            if (PyDict_SetItem(fields, PyList_GET_ITEM(strings, record.fields[2 * j]),
+                               obj) < 0) {
+                Py_DECREF(obj);
+                goto except;
+            }
+            Py_DECREF(obj);
+        }
+        Py_CLEAR(fields);
+        if (result < 0) {
+            break;
+        }
+        if ((obj = PyLong_FromUnsignedLongLong(record.time)) == NULL) {
+            goto except;
+        }
+        if (PyDict_SetItem(point, time_key, obj) < 0) {
+            Py_DECREF(obj);
+            goto except;
+        }
+        Py_DECREF(obj);
+    }
+    if (result == 0) {
+        goto finally;
+    }
+    PyErr_SetString(PyExc_ValueError, "Invalid batch data.");
+except:
+    Py_CLEAR(output);
+finally:
+#if PY_VERSION_HEX >= 0x030A0000
+    if (gc_enabled) {
+        PyGC_Enable();
+    }
+#endif
+    LP_close_batch(&reader);
+    Py_XDECREF(tags);
+    Py_XDECREF(fields);
+    Py_XDECREF(measurement_key);
+    Py_XDECREF(tags_key);
+    Py_XDECREF(fields_key);
+    Py_XDECREF(time_key);
+    Py_XDECREF(template);
+    Py_XDECREF(shapes);
+    Py_XDECREF(series);
+    Py_XDECREF(strings);
+    PyBuffer_Release(&buffer);
+    return output;
+}
+
+static PyMethodDef _line_protocol_functions[] = {
+    {"parse_line", (PyCFunction)parse_line, METH_O, parse_line__doc__},
+    {"dump_batch", (PyCFunction)dump_batch, METH_O, dump_batch__doc__},
+    {"load_batch", (PyCFunction)load_batch, METH_O, load_batch__doc__},
+    {"build_index", (PyCFunction)(void(*)(void))build_index,
+     METH_VARARGS | METH_KEYWORDS, build_index__doc__},
+    {"parse_file", (PyCFunction)(void(*)(void))parse_file,
+     METH_VARARGS | METH_KEYWORDS, parse_file__doc__},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef _line_protocol_parser_module = {
+	PyModuleDef_HEAD_INIT,
+	"_line_protocol_parser",
+	module_doc,
+	-1,
+	_line_protocol_functions
+};
+
+PyMODINIT_FUNC
+PyInit__line_protocol_parser(void){
+    PyObject* module = PyModule_Create(&_line_protocol_parser_module);
+    if (module == NULL) {
+        return NULL;
+    }
+    LineFormatError = PyErr_NewExceptionWithDoc(
+        "_line_protocol_parser.LineFormatError", LineFormatError__doc__, NULL, NULL);
+    Py_XINCREF(LineFormatError);
+    if (PyModule_AddObject(module, "LineFormatError", LineFormatError) < 0){
+        Py_XDECREF(LineFormatError);
+        Py_DECREF(module);
+        return NULL;
+    }
+    if (PyType_Ready(&AggregatorType) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    Py_INCREF(&AggregatorType);
+    if (PyModule_AddObject(module, "Aggregator", (PyObject *)&AggregatorType) < 0) {
+        Py_DECREF(&AggregatorType);
+        Py_DECREF(module);
+        return NULL;
+    }
+#ifndef _WIN32
+    if (PyType_Ready(&ListenerType) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    Py_INCREF(&ListenerType);
+    if (PyModule_AddObject(module, "Listener", (PyObject *)&ListenerType) < 0) {
+        Py_DECREF(&ListenerType);
+        Py_DECREF(module);
+        return NULL;
+    }
+#endif
+    if (PyType_Ready(&ReaderType) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    Py_INCREF(&ReaderType);
+    if (PyModule_AddObject(module, "Reader", (PyObject *)&ReaderType) < 0) {
+        Py_DECREF(&ReaderType);
         Py_DECREF(module);
         return NULL;
     }
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "line_protocol_parser.h"
+
+/* (Used to override malloc/free in Python C extension) */
+#ifndef LP_MALLOC
+#define LP_MALLOC malloc
+#endif
+#ifndef LP_FREE
+#define LP_FREE free
+#endif
+
+/* Serialized index: magic, file size, file mtime, block size, number of
+ * blocks and then offset, length, min and max time of every block. All
+ * integers are 64 bit little-endian. */
+static const char LP_INDEX_MAGIC[8] = {'L', 'P', 'T', 'I', 'D', 'X', '0', '1'};
+#define LP_INDEX_HEADER_SIZE 40
+#define LP_INDEX_BLOCK_SIZE 32
+
+/* Read the timestamp of a line without parsing it. The timestamp is the
+ * last word of the line, following an unescaped space. Returns 0 if the
+ * line has no timestamp, in which case `time` is set to 0 just like
+ * `LP_parse_line` does. */
+int
+LP_scan_time(const char *line, size_t length, unsigned long long *time)
+{
+    char buffer[32];
+    size_t start = length;
+    *time = 0;
+    while (start > 0 && line[start - 1] != ' ') {
+        if (line[start - 1] == '=' || line[start - 1] == '"') {
+            /* Last word is a field */
+            return 0;
+        }
+        start--;
+    }
+    if (start < 2 || line[start - 2] == '\\' || start == length
+        || length - start >= sizeof(buffer)) {
+        return 0;
+    }
+    memcpy(buffer, line + start, length - start);
+    buffer[length - start] = '\0';
+    *time = strtoull(buffer, NULL, 10);
+    return 1;
+}
+
+int
+LP_init_time_index(struct LP_TimeIndex *index, unsigned long long block_size)
+{
+    index->blocks = NULL;
+    index->nr_blocks = 0;
+    index->capacity = 0;
+    index->block_size = block_size > 0 ? block_size : 1;
+    index->offset = 0;
+    index->file_size = 0;
+    index->file_mtime = 0;
+    return 1;
+}
+
+void
+LP_free_time_index(struct LP_TimeIndex *index)
+{
+    LP_FREE(index->blocks);
+    index->blocks = NULL;
+    index->nr_blocks = 0;
+    index->capacity = 0;
+}
+
+static struct LP_TimeBlock*
+new_block(struct LP_TimeIndex *index)
+{
+    struct LP_TimeBlock *blocks = NULL;
+    struct LP_TimeBlock *block = NULL;
+    size_t capacity = index->capacity > 0 ? 2 * index->capacity : 64;
+    if (index->nr_blocks == index->capacity) {
+        if ((blocks = LP_MALLOC(capacity * sizeof(*blocks))) == NULL) {
+            return NULL;
+        }
+        if (index->nr_blocks > 0) {
+            memcpy(blocks, index->blocks, index->nr_blocks * sizeof(*blocks));
+        }
+        LP_FREE(index->blocks);
+        index->blocks = blocks;
+        index->capacity = capacity;
+    }
+    block = &index->blocks[index->nr_blocks++];
+    block->offset = index->offset;
+    block->length = 0;
+    block->min_time = ULLONG_MAX;
+    block->max_time = 0;
+    return block;
+}
+
+/* Add the complete lines of `data` to the index. When `final` is set the
+ * data ends the file and the last line does not need a terminator.
+ * Returns the number of bytes consumed, the rest must be passed again
+ * with more data. Sets `*status` to LP_MEMORY_ERROR on failure. */
+size_t
+LP_time_index_scan(struct LP_TimeIndex *index, const char *data, size_t length,
+                   int final, int *status)
+{
+    struct LP_TimeBlock *block = NULL;
+    unsigned long long time = 0;
+    size_t offset = 0;
+    size_t next = 0;
+    size_t line_length = 0;
+    *status = 0;
+    if (index->nr_blocks > 0) {
+        block = &index->blocks[index->nr_blocks - 1];
+    }
+    while (offset < length) {
+        line_length = LP_next_line(data + offset, length - offset, &next);
+        if (!final && data[offset + next - 1] != '\n') {
+            break;
+        }
+        if (block == NULL || block->length >= index->block_size) {
+            if ((block = new_block(index)) == NULL) {
+                *status = LP_MEMORY_ERROR;
+                break;
+            }
+        }
+        if (!LP_is_blank_line(data + offset, line_length)) {
+            LP_scan_time(data + offset, line_length, &time);
+            if (time < block->min_time) {
+                block->min_time = time;
+            }
+            if (time > block->max_time) {
+                block->max_time = time;
+            }
+        }
+        block->length += next;
+        index->offset += next;
+        offset += next;
+    }
+    return offset;
+}
+
+static void
+put_u64(char *out, unsigned long long value)
+{
+    int i;
+    for (i = 0; i < 8; i++) {
+        out[i] = (char)((value >> (8 * i)) & 0xff);
+    }
+}
+
+static unsigned long long
+get_u64(const char *in)
+{
+    unsigned long long value = 0;
+    int i;
+    for (i = 7; i >= 0; i--) {
+        value = (value << 8) | (unsigned char)in[i];
+    }
+    return value;
+}
+
+size_t
+LP_time_index_encoded_size(const struct LP_TimeIndex *index)
+{
+    return LP_INDEX_HEADER_SIZE + index->nr_blocks * LP_INDEX_BLOCK_SIZE;
+}
+
+void
+LP_encode_time_index(const struct LP_TimeIndex *index, char *out)
+{
+    size_t i;
+    memcpy(out, LP_INDEX_MAGIC, sizeof(LP_INDEX_MAGIC));
+    put_u64(out + 8, index->file_size);
+    put_u64(out + 16, index->file_mtime);
+    put_u64(out + 24, index->block_size);
+    put_u64(out + 32, index->nr_blocks);
+    out += LP_INDEX_HEADER_SIZE;
+    for (i = 0; i < index->nr_blocks; i++) {
+        put_u64(out, index->blocks[i].offset);
+        put_u64(out + 8, index->blocks[i].length);
+        put_u64(out + 16, index->blocks[i].min_time);
+        put_u64(out + 24, index->blocks[i].max_time);
+        out += LP_INDEX_BLOCK_SIZE;
+    }
+}
+
+/* Returns 1 on success, 0 if the data is not a valid index and -1 on
+ * memory error. */
+int
+LP_decode_time_index(struct LP_TimeIndex *index, const char *data, size_t length)
+{
+    unsigned long long nr_blocks = 0;
+    size_t i;
+    if (length < LP_INDEX_HEADER_SIZE
+        || memcmp(data, LP_INDEX_MAGIC, sizeof(LP_INDEX_MAGIC)) != 0) {
+        return 0;
+    }
+    nr_blocks = get_u64(data + 32);
+    if (nr_blocks != (length - LP_INDEX_HEADER_SIZE) / LP_INDEX_BLOCK_SIZE
+        || (length - LP_INDEX_HEADER_SIZE) % LP_INDEX_BLOCK_SIZE != 0) {
+        return 0;
+    }
+    LP_free_time_index(index);
+    LP_init_time_index(index, get_u64(data + 24));
+    index->file_size = get_u64(data + 8);
+    index->file_mtime = get_u64(data + 16);
+    if (nr_blocks > 0) {
+        if ((index->blocks = LP_MALLOC(nr_blocks * sizeof(*index->blocks))) == NULL) {
+            return -1;
+        }
+        index->capacity = nr_blocks;
+        index->nr_blocks = nr_blocks;
+    }
+    data += LP_INDEX_HEADER_SIZE;
+    for (i = 0; i < index->nr_blocks; i++) {
+        index->blocks[i].offset = get_u64(data);
+        index->blocks[i].length = get_u64(data + 8);
+        index->blocks[i].min_time = get_u64(data + 16);
+        index->blocks[i].max_time = get_u64(data + 24);
+        data += LP_INDEX_BLOCK_SIZE;
+    }
+    index->offset = index->file_size;
+    return 1;
+}
@@ -0,0 +1,109 @@
+"""Test Aggregator"""
+
+# Built-in imports
+import unittest
+
+# Project
+from line_protocol_parser import Aggregator, LineFormatError
+
+
+class TestAggregator(unittest.TestCase):
+    """Test downsampling of lines into buckets"""
+
+    def test_single_bucket(self):
+        agg = Aggregator(10)
+        rows = agg.feed('cpu,host=a v=1.5 1\ncpu,host=a v=0.5 5\n'
+                        'cpu,host=a v=2.0 9\n')
+        self.assertListEqual(rows, [])
+        rows = agg.flush()
+        self.assertListEqual(rows, [dict(
+            measurement='cpu',
+            tags=dict(host='a'),
+            fields=dict(count_v=3, min_v=0.5, max_v=2.0, sum_v=4.0, last_v=2.0),
+            time=0)])
+
+    def test_bucket_close(self):
+        agg = Aggregator(10)
+        rows = agg.feed('cpu v=1i 1\ncpu v=3i 2\ncpu v=5i 11\n')
+        self.assertEqual(len(rows), 1)
+        self.assertEqual(rows[0]['time'], 0)
+        self.assertDictEqual(rows[0]['fields'], dict(
+            count_v=2, min_v=1, max_v=3, sum_v=4, last_v=3))
+        rows = agg.flush()
+        self.assertEqual(rows[0]['time'], 10)
+        self.assertEqual(rows[0]['fields']['sum_v'], 5)
+        self.assertListEqual(agg.flush(), [])
+
+    def test_series_grouping(self):
+        agg = Aggregator(10)
+        agg.feed('cpu,a=1,b=2 v=1 1\ncpu,b=2,a=1 v=2 2\n'
+                 'cpu,a=1 v=3 3\nmem,a=1,b=2 v=4 4\n')
+        rows = agg.flush()
+        self.assertEqual(len(rows), 3)
+        self.assertEqual(rows[0]['tags'], dict(a='1', b='2'))
+        self.assertEqual(rows[0]['fields']['count_v'], 2)
+        self.assertEqual(rows[1]['tags'], dict(a='1'))
+        self.assertEqual(rows[2]['measurement'], 'mem')
+
+    def test_unsigned(self):
+        agg = Aggregator(10)
+        agg.feed('m v=18446744073709551615u 1\nm v=1u 2\n')
+        fields = agg.flush()[0]['fields']
+        self.assertEqual(fields['min_v'], 1)
+        self.assertEqual(fields['max_v'], 18446744073709551615)
+
+    def test_non_numeric_ignored(self):
+        agg = Aggregator(10)
+        agg.feed('m s="x",b=t,v=1 1\n')
+        self.assertDictEqual(agg.flush()[0]['fields'], dict(
+            count_v=1, min_v=1.0, max_v=1.0, sum_v=1.0, last_v=1.0))
+
+    def test_no_numeric_fields(self):
+        agg = Aggregator(10)
+        agg.feed('m s="x" 1\nm,t=a b=t 2\nm v=1i 3\n')
+        rows = agg.flush()
+        self.assertEqual(len(rows), 1)
+        self.assertEqual(rows[0]['fields']['count_v'], 1)
+
+    def test_type_conflict(self):
+        agg = Aggregator(10)
+        agg.feed('m v=1 1\nm v=2i 2\nm v=3 3\n')
+        self.assertEqual(agg.conflicts, 1)
+        self.assertEqual(agg.flush()[0]['fields']['count_v'], 2)
+
+    def test_late(self):
+        agg = Aggregator(10)
+        agg.feed('m v=1 15\nm v=1 5\n')
+        self.assertEqual(agg.late, 1)
+        agg = Aggregator(10, lateness=10)
+        agg.feed('m v=1 15\nm v=1 5\n')
+        self.assertEqual(agg.late, 0)
+        self.assertEqual(len(agg.flush()), 2)
+
+    def test_max_rows(self):
+        agg = Aggregator(10, max_rows=2)
+        rows = agg.feed('m,t=1 v=1 1\nm,t=2 v=1 1\nm,t=3 v=1 1\n')
+        self.assertEqual(agg.evicted, 1)
+        self.assertEqual(len(rows), 1)
+        self.assertEqual(rows[0]['tags'], dict(t='1'))
+
+    def test_blank_and_comment_lines(self):
+        agg = Aggregator(10)
+        agg.feed(b'# comment\r\n\r\nm v=1 1\r\n')
+        self.assertEqual(len(agg.flush()), 1)
+
+    def test_error_keeps_state(self):
+        agg = Aggregator(10)
+        with self.assertRaisesRegex(LineFormatError, 'line 2'):
+            agg.feed('m v=1 1\nm v=hej 2\n')
+        self.assertEqual(agg.flush()[0]['fields']['count_v'], 1)
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            Aggregator(0)
+        with self.assertRaises(ValueError):
+            Aggregator(10, max_rows=0)
+
+
+if __name__ == '__main__':
+    unittest.main()
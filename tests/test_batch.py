@@ -0,0 +1,107 @@
+"""Test dump_batch and load_batch"""
+
+# Built-in imports
+import mmap
+import os
+import tempfile
+import unittest
+
+# Project
+from line_protocol_parser import (
+    dump_batch, load_batch, parse_line, LineFormatError)
+
+
+LINES = [
+    'cpu,host=h{0},region=eu usage={0}.5,count={0}i,ok=t,msg="hello {0}" {0}'
+    .format(i) for i in range(100)] + [
+        'weird\\ name,a\\,b=c\\=d u=18446744073709551615u,i=-9223372036854775808i',
+        'no_tags f=-1e-10,s="quote \\" and \\\\",e="" 0',
+        'cpu,host=h1 usage=1 1']
+
+
+class TestBatch(unittest.TestCase):
+    """Test binary batch round trips"""
+
+    def setUp(self):
+        self.points = [parse_line(line) for line in LINES]
+
+    def test_round_trip(self):
+        data = dump_batch('\n'.join(LINES))
+        self.assertIsInstance(data, bytes)
+        self.assertListEqual(load_batch(data), self.points)
+        self.assertListEqual(load_batch(dump_batch(
+            '\n'.join(LINES).encode())), self.points)
+
+    def test_round_trip_dicts(self):
+        data = dump_batch(self.points)
+        self.assertListEqual(load_batch(data), self.points)
+        self.assertEqual(data, dump_batch(load_batch(data)))
+
+    def test_dict_types(self):
+        point = {'measurement': 'm', 'tags': {'t': 'v'}, 'time': 1,
+                 'fields': {'b': False, 'i': -3, 'u': 2 ** 64 - 1,
+                            'f': 0.25, 's': 'x'}}
+        loaded = load_batch(dump_batch([point]))[0]
+        self.assertDictEqual(loaded, point)
+        self.assertIs(loaded['fields']['b'], False)
+        with self.assertRaises(OverflowError):
+            dump_batch([{'measurement': 'm', 'fields': {'v': 2 ** 64}}])
+        with self.assertRaises(TypeError):
+            dump_batch([{'measurement': 'm', 'fields': {'v': None}}])
+        with self.assertRaises(KeyError):
+            dump_batch([{'fields': {'v': 1}}])
+
+    def test_buffers(self):
+        data = dump_batch('\n'.join(LINES))
+        self.assertListEqual(load_batch(bytearray(data)), self.points)
+        self.assertListEqual(load_batch(memoryview(data)), self.points)
+        fd, path = tempfile.mkstemp(suffix='.lpb')
+        try:
+            with os.fdopen(fd, 'wb') as f_obj:
+                f_obj.write(data)
+            with open(path, 'rb') as f_obj:
+                with mmap.mmap(f_obj.fileno(), 0,
+                               access=mmap.ACCESS_READ) as buffer:
+                    self.assertListEqual(load_batch(buffer), self.points)
+        finally:
+            os.remove(path)
+
+    def test_empty(self):
+        self.assertListEqual(load_batch(dump_batch('')), [])
+        self.assertListEqual(load_batch(dump_batch([])), [])
+
+    def test_compact(self):
+        text = '\n'.join(
+            'cpu,host=h{0},region=eu idle={1}.5,user=2.5,procs={1}i {2}'
+            .format(i % 10, i, 1700000000000000000 + i * 10 ** 9)
+            for i in range(1000))
+        data = dump_batch(text)
+        self.assertLess(len(data), len(text) / 2)
+        self.assertListEqual(load_batch(data),
+                             [parse_line(line) for line in text.split('\n')])
+
+    def test_invalid(self):
+        data = dump_batch('\n'.join(LINES))
+        for bad in (b'', b'LPBATCH1', data[:-1], data + b'\x00',
+                    b'X' + data[1:], data[:12] + b'\xff' * (len(data) - 12)):
+            with self.assertRaises(ValueError):
+                load_batch(bad)
+
+    def test_corrupt(self):
+        # Damaged data may still decode, but must never crash
+        data = dump_batch('\n'.join(LINES[-4:]))
+        for i in range(len(data)):
+            for byte in (0x00, 0x7f, 0x80, 0xff):
+                bad = data[:i] + bytes([byte]) + data[i + 1:]
+                try:
+                    load_batch(bad)
+                except ValueError:
+                    pass
+
+    def test_line_error(self):
+        with self.assertRaisesRegex(LineFormatError, 'line 2'):
+            dump_batch('m v=1 1\nm v=x 2\n')
+
+
+if __name__ == '__main__':
+    unittest.main()
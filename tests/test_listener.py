@@ -0,0 +1,251 @@
+"""Test Listener"""
+
+# Built-in imports
+import signal
+import socket
+import struct
+import threading
+import time
+import unittest
+
+# Project
+import line_protocol_parser
+from line_protocol_parser import parse_line
+
+Listener = getattr(line_protocol_parser, 'Listener', None)
+
+
+def wait_for(predicate, timeout=5):
+    deadline = time.monotonic() + timeout
+    while not predicate():
+        if time.monotonic() > deadline:
+            raise AssertionError('timed out')
+        time.sleep(0.01)
+
+
+@unittest.skipIf(Listener is None, 'Listener not available on this platform')
+class TestListener(unittest.TestCase):
+    """Test receiving line protocol on loopback"""
+
+    def setUp(self):
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.server.bind(('127.0.0.1', 0))
+        self.client = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.address = self.server.getsockname()
+
+    def tearDown(self):
+        self.server.close()
+        self.client.close()
+
+    def collect(self, listener, nr_points):
+        points = []
+        while len(points) < nr_points:
+            batch = listener.get(timeout=5)
+            self.assertIsNotNone(batch)
+            points.extend(batch)
+        return points
+
+    def test_udp(self):
+        listener = Listener(self.server)
+        lines = ['cpu,host=a v={0} {0}'.format(i) for i in range(100)]
+        for line in lines:
+            self.client.sendto(line.encode(), self.address)
+        self.assertListEqual(self.collect(listener, 100),
+                             [parse_line(line) for line in lines])
+        stats = listener.stats
+        self.assertEqual(stats['reads'], 100)
+        self.assertEqual(stats['points'], 100)
+        listener.close()
+
+    def test_udp_multiple_lines_and_errors(self):
+        listener = Listener(self.server, max_batch=4)
+        self.client.sendto(b'm v=1 1\nm v=hej 2\nm v=3 3\n', self.address)
+        points = self.collect(listener, 2)
+        self.assertListEqual([p['time'] for p in points], [1, 3])
+        wait_for(lambda: listener.stats['errors'] == 1)
+        listener.close()
+
+    def test_truncated_datagram(self):
+        listener = Listener(self.server, datagram_size=8)
+        self.client.sendto(b'm v=1 123456789', self.address)
+        self.client.sendto(b'm v=1 1', self.address)
+        self.assertEqual(self.collect(listener, 1)[0]['time'], 1)
+        self.assertEqual(listener.stats['errors'], 1)
+        listener.close()
+
+    def test_reused_datagram_buffer(self):
+        # The second datagram is parsed in place after the first one's bytes
+        listener = Listener(self.server, max_batch=1)
+        self.client.sendto(b'm v=1,w=2', self.address)
+        self.client.sendto(b'm v=3', self.address)
+        points = self.collect(listener, 2)
+        self.assertListEqual([p['fields'] for p in points],
+                             [dict(v=1.0, w=2.0), dict(v=3.0)])
+        self.assertEqual(listener.stats['errors'], 0)
+        listener.close()
+
+    def test_drop(self):
+        listener = Listener(self.server, max_queue=1)
+        for i in range(3):
+            self.client.sendto('m v=1 {}'.format(i).encode(), self.address)
+            wait_for(lambda: listener.stats['reads'] == i + 1)
+        stats = listener.stats
+        self.assertEqual(stats['queued'], 1)
+        self.assertEqual(stats['dropped'], 2)
+        self.assertEqual(listener.get()[0]['time'], 0)
+        listener.close()
+
+    def test_block(self):
+        listener = Listener(self.server, max_batch=1, max_queue=1, block=True)
+        for i in range(3):
+            self.client.sendto('m v=1 {}'.format(i).encode(), self.address)
+        wait_for(lambda: listener.stats['blocked'] == 1)
+        points = self.collect(listener, 3)
+        self.assertListEqual([p['time'] for p in points], [0, 1, 2])
+        stats = listener.stats
+        self.assertEqual(stats['dropped'], 0)
+        self.assertEqual(stats['blocked'], 2)
+        listener.close()
+
+    def test_get_timeout_and_close(self):
+        listener = Listener(self.server)
+        self.assertIsNone(listener.get(timeout=0.05))
+        self.assertIsNone(listener.get(timeout=0.25))
+        self.client.sendto(b'm v=1 1', self.address)
+        wait_for(lambda: listener.stats['queued'] == 1)
+        listener.close()
+        # Queued batches are still delivered after close
+        self.assertEqual(len(listener.get()), 1)
+        with self.assertRaises(EOFError):
+            listener.get()
+
+    def test_tcp(self):
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.bind(('127.0.0.1', 0))
+        server.listen(1)
+        client = socket.create_connection(server.getsockname())
+        conn, _ = server.accept()
+        try:
+            listener = Listener(conn, datagram_size=16)
+            lines = ['cpu,host=a v={0} {0}\n'.format(i) for i in range(50)]
+            data = ''.join(lines).encode()
+            # Send in pieces that split lines
+            for i in range(0, len(data), 7):
+                client.sendall(data[i:i + 7])
+            client.sendall(b'm v=1 99')
+            client.close()
+            points = []
+            for batch in listener:
+                points.extend(batch)
+            self.assertListEqual(
+                points, [parse_line(line) for line in lines]
+                + [parse_line('m v=1 99')])
+        finally:
+            conn.close()
+            server.close()
+
+    def test_tcp_line_too_long(self):
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.bind(('127.0.0.1', 0))
+        server.listen(1)
+        client = socket.create_connection(server.getsockname())
+        conn, _ = server.accept()
+        try:
+            listener = Listener(conn, datagram_size=16)
+            client.sendall(b'm v=1 1\n' + b'x' * (3 << 20) + b'\nm v=2 2\n')
+            client.close()
+            points = []
+            for batch in listener:
+                points.extend(batch)
+            self.assertListEqual([p['time'] for p in points], [1, 2])
+            self.assertEqual(listener.stats['errors'], 1)
+        finally:
+            conn.close()
+            server.close()
+
+    def test_tcp_reset(self):
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.bind(('127.0.0.1', 0))
+        server.listen(1)
+        client = socket.create_connection(server.getsockname())
+        conn, _ = server.accept()
+        try:
+            listener = Listener(conn)
+            client.sendall(b'm v=1 1\n')
+            wait_for(lambda: listener.stats['queued'] == 1)
+            # Close with a reset instead of a FIN
+            client.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER,
+                              struct.pack('ii', 1, 0))
+            client.close()
+            self.assertEqual(listener.get(timeout=5)[0]['time'], 1)
+            with self.assertRaises(ConnectionResetError):
+                listener.get(timeout=5)
+            with self.assertRaises(ConnectionResetError):
+                next(iter(listener))
+            listener.close()
+        finally:
+            conn.close()
+            server.close()
+
+    def test_feed(self):
+        listener = Listener(max_queue=2, block=False)
+        listener.feed('m v=1 1\nm v=2 2\n')
+        listener.feed(b'm v=3 3')
+        listener.feed(b'm v=4 4')
+        self.assertEqual(len(listener.get()), 2)
+        self.assertEqual(len(listener.get()), 1)
+        self.assertIsNone(listener.get(timeout=0))
+        self.assertEqual(listener.stats['dropped'], 1)
+        listener.close()
+        with self.assertRaises(EOFError):
+            listener.get()
+
+    def test_feed_block(self):
+        listener = Listener(max_queue=1, block=True)
+        listener.feed('m v=1 1')
+        getter = threading.Timer(0.3, listener.get)
+        getter.start()
+        # Waits for the getter to make room
+        listener.feed('m v=2 2')
+        getter.join()
+        self.assertEqual(listener.get()[0]['time'], 2)
+        stats = listener.stats
+        self.assertEqual(stats['blocked'], 1)
+        self.assertEqual(stats['points'], 2)
+        listener.close()
+
+    @unittest.skipIf(not hasattr(signal, 'setitimer'), 'setitimer not available')
+    def test_feed_block_interrupt(self):
+        def interrupt(signum, frame):
+            raise KeyboardInterrupt
+        listener = Listener(max_queue=1, block=True)
+        listener.feed('m v=1 1')
+        handler = signal.signal(signal.SIGALRM, interrupt)
+        try:
+            signal.setitimer(signal.ITIMER_REAL, 0.3)
+            with self.assertRaises(KeyboardInterrupt):
+                listener.feed('m v=2 2')
+        finally:
+            signal.setitimer(signal.ITIMER_REAL, 0)
+            signal.signal(signal.SIGALRM, handler)
+        self.assertEqual(listener.stats['points'], 1)
+        # Closing ends the wait, the batch is dropped
+        listener.close()
+        listener.feed('m v=3 3')
+        self.assertEqual(listener.stats['dropped'], 1)
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            Listener(max_queue=0)
+        with self.assertRaises(ValueError):
+            Listener(self.server, max_batch=1025)
+        with self.assertRaises(ValueError):
+            Listener(self.server, datagram_size=2 ** 31)
+        with self.assertRaises(ValueError):
+            Listener(max_queue=2 ** 62)
+        with self.assertRaises(TypeError):
+            Listener('not a socket')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,95 @@
+"""Test build_index and parse_file"""
+
+# Built-in imports
+import os
+import tempfile
+import unittest
+
+# Project
+from line_protocol_parser import (
+    build_index, parse_file, parse_line, LineFormatError)
+
+
+LINES = [
+    'cpu,host=h{0} usage={0}.5,msg="a b {0}" {0}'.format(t)
+    for t in range(0, 10000, 10)]
+
+
+class TestParseFile(unittest.TestCase):
+    """Test time range reads of line protocol files"""
+
+    def setUp(self):
+        fd, self.path = tempfile.mkstemp(suffix='.lp')
+        # Binary mode, so offsets are the same on every platform
+        with os.fdopen(fd, 'wb') as f_obj:
+            f_obj.write(b'# header\n')
+            f_obj.write('\n'.join(LINES).encode())
+        self.points = [parse_line(line) for line in LINES]
+
+    def tearDown(self):
+        for path in (self.path, self.path + '.lpidx'):
+            if os.path.exists(path):
+                os.remove(path)
+
+    def expected(self, start, end):
+        return [p for p in self.points if start <= p['time'] < end]
+
+    def test_without_index(self):
+        self.assertListEqual(parse_file(self.path), self.points)
+        self.assertListEqual(parse_file(self.path, 105, 200),
+                             self.expected(105, 200))
+
+    def test_with_index(self):
+        blocks = build_index(self.path, block_size=1000)
+        self.assertGreater(blocks, 10)
+        self.assertTrue(os.path.exists(self.path + '.lpidx'))
+        self.assertListEqual(parse_file(self.path), self.points)
+        for start, end in ((0, 1), (105, 200), (5000, 5010), (9990, 20000),
+                           (20000, 30000), (100, 100)):
+            self.assertListEqual(parse_file(self.path, start, end),
+                                 self.expected(start, end))
+        self.assertListEqual(parse_file(self.path, start=9000),
+                             self.expected(9000, 10000))
+        self.assertListEqual(parse_file(self.path, end=50),
+                             self.expected(0, 50))
+
+    def test_stale_index(self):
+        build_index(self.path, block_size=1000)
+        with open(self.path, 'ab') as f_obj:
+            f_obj.write(b'\ncpu,host=x usage=1 20000\n')
+        self.assertEqual(len(parse_file(self.path, 20000)), 1)
+
+    def test_unterminated_timestamp_less(self):
+        with open(self.path, 'wb') as f_obj:
+            f_obj.write(b'm v=1 5\nm v=2')
+        build_index(self.path)
+        self.assertListEqual([p['time'] for p in parse_file(self.path)], [5, 0])
+        self.assertListEqual(parse_file(self.path, 1), [parse_line('m v=1 5')])
+
+    def test_unterminated_multi_field(self):
+        with open(self.path, 'wb') as f_obj:
+            f_obj.write(b'm v=1,w=2 5\nm v=3')
+        expected = [dict(v=1.0, w=2.0), dict(v=3.0)]
+        self.assertListEqual([p['fields'] for p in parse_file(self.path)],
+                             expected)
+        build_index(self.path)
+        self.assertListEqual([p['fields'] for p in parse_file(self.path)],
+                             expected)
+
+    def test_error(self):
+        with open(self.path, 'wb') as f_obj:
+            f_obj.write(b'm v=1 5\nm v=x 6\n')
+        build_index(self.path)
+        with self.assertRaisesRegex(LineFormatError, 'offset 8'):
+            parse_file(self.path)
+        self.assertEqual(len(parse_file(self.path, 0, 6)), 1)
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            build_index(self.path, block_size=0)
+        with self.assertRaises(FileNotFoundError):
+            parse_file(self.path + '.missing')
+
+
+if __name__ == '__main__':
+    unittest.main()
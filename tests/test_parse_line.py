@@ -1,10 +1,11 @@
 """Test parse_line"""
 
 # Built-in imports
+import io
 import unittest
 
 # Project
-from line_protocol_parser import parse_line, LineFormatError
+from line_protocol_parser import Reader, parse_line, LineFormatError
 
 
 class TestPoint(unittest.TestCase):
@@ -134,6 +135,15 @@ class TestPoint(unittest.TestCase):
             time=0)
         self.assertDictEqual(p, params)
 
+    def test_unterminated_buffer(self):
+        # parse_line copies its argument, so go through a Reader, whose
+        # buffer still holds ',' from the previous line after 'f0=3'
+        data = b'foobar f0=1,f1=2\nfoobar f0=3'
+        for size in range(1, len(data) + 1):
+            reader = Reader(io.BytesIO(data), buffer_size=size)
+            self.assertListEqual([p['fields'] for p in reader],
+                                 [dict(f0=1.0, f1=2.0), dict(f0=3.0)])
+
     # TEST ERRORS
     def test_empty_line_error(self):
         with self.assertRaisesRegex(LineFormatError, 'empty string'):
@@ -0,0 +1,93 @@
+"""Test Reader"""
+
+# Built-in imports
+import gzip
+import io
+import unittest
+import zlib
+
+# Project
+from line_protocol_parser import Reader, parse_line, LineFormatError
+
+try:
+    from compression import zstd
+except ImportError:
+    zstd = None
+
+
+LINES = ''.join(
+    'cpu,host=h{0} usage={0}.5,count={0}i,msg="hello {0}" {0}\n'.format(i)
+    for i in range(500)).encode()
+POINTS = [parse_line(line) for line in LINES.splitlines()]
+
+
+class TestReader(unittest.TestCase):
+    """Test iterating over line protocol streams"""
+
+    def test_identity(self):
+        self.assertListEqual(list(Reader(io.BytesIO(LINES))), POINTS)
+
+    def test_small_buffer(self):
+        # Lines span several refills and are longer than the buffer
+        reader = Reader(io.BytesIO(LINES), buffer_size=7)
+        self.assertListEqual(list(reader), POINTS)
+
+    def test_gzip(self):
+        data = gzip.compress(LINES)
+        for size in (1, 100, 65536):
+            reader = Reader(io.BytesIO(data), 'gzip', buffer_size=size)
+            self.assertListEqual(list(reader), POINTS)
+
+    def test_gzip_members(self):
+        data = gzip.compress(LINES[:1000]) + gzip.compress(LINES[1000:])
+        reader = Reader(io.BytesIO(data), 'gzip', buffer_size=64)
+        self.assertListEqual(list(reader), POINTS)
+
+    def test_deflate(self):
+        data = zlib.compress(LINES)
+        reader = Reader(io.BytesIO(data), 'deflate', buffer_size=64)
+        self.assertListEqual(list(reader), POINTS)
+
+    @unittest.skipIf(zstd is None, 'compression.zstd not available')
+    def test_zstd(self):
+        data = zstd.compress(LINES)
+        reader = Reader(io.BytesIO(data), 'zstd', buffer_size=64)
+        self.assertListEqual(list(reader), POINTS)
+
+    def test_truncated(self):
+        data = gzip.compress(LINES)[:-20]
+        with self.assertRaises(EOFError):
+            list(Reader(io.BytesIO(data), 'gzip'))
+
+    def test_empty(self):
+        self.assertListEqual(list(Reader(io.BytesIO(b''))), [])
+        self.assertListEqual(list(Reader(io.BytesIO(b''), 'gzip')), [])
+
+    def test_no_trailing_newline(self):
+        reader = Reader(io.BytesIO(b'# comment\r\nm v=1 1\r\n\nm v=2 2'))
+        self.assertListEqual([p['time'] for p in reader], [1, 2])
+
+    def test_unterminated_last_line(self):
+        # The last line is parsed in place, after a longer line's bytes
+        reader = Reader(io.BytesIO(b'm v=1,w=2\nm v=3'), buffer_size=10)
+        self.assertListEqual([p['fields'] for p in reader],
+                             [dict(v=1.0, w=2.0), dict(v=3.0)])
+
+    def test_line_error(self):
+        reader = Reader(io.BytesIO(b'm v=1 1\nm v=hej 2\nm v=3 3\n'))
+        self.assertEqual(next(reader)['time'], 1)
+        with self.assertRaisesRegex(LineFormatError, 'line 2'):
+            next(reader)
+        self.assertEqual(next(reader)['time'], 3)
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            Reader(io.BytesIO(b''), 'br')
+        with self.assertRaises(ValueError):
+            Reader(io.BytesIO(b''), buffer_size=0)
+        with self.assertRaises(TypeError):
+            list(Reader(io.StringIO('m v=1 1')))
+
+
+if __name__ == '__main__':
+    unittest.main()